@@ -0,0 +1,951 @@
+// benchmarks for the order book, the matching engine, the thread pool and
+// the monte carlo code
+// build: cmake --preset native && cmake --build build/native --target benchmark
+// run everything with ./benchmark or pick cases by name, ./benchmark order_churn.
+// --json / --csv save the results, --compare takes a csv from an earlier run
+// and fails when a case got slower by more than --threshold percent (10).
+#include "feed.hpp"
+#include "latency.hpp"
+#include "matching_engine.hpp"
+#include "monte_carlo.hpp"
+#include "option_pricing.hpp"
+#include "order_book.hpp"
+#include "sampling.hpp"
+#include "snapshot.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// every heap allocation in the process goes through here so a benchmark can
+// report allocations per operation: plain, array and over-aligned forms (the
+// alignas(64) queues, shards and accumulators). the nothrow forms of the
+// standard library call these. gcc cannot see that the replaced new and
+// delete belong together and warns on the deallocations.
+static std::atomic<size_t> allocation_count{0};
+
+static void *counted_alloc(size_t size, size_t alignment) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    size = size ? size : 1;
+    void *p = alignment <= alignof(std::max_align_t)
+                  ? std::malloc(size)
+                  : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void *operator new(size_t size) { return counted_alloc(size, 0); }
+void *operator new[](size_t size) { return counted_alloc(size, 0); }
+void *operator new(size_t size, std::align_val_t al) {
+    return counted_alloc(size, static_cast<size_t>(al));
+}
+void *operator new[](size_t size, std::align_val_t al) {
+    return counted_alloc(size, static_cast<size_t>(al));
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+using bench_clock = std::chrono::steady_clock;
+
+// every case reports through here. the text line goes to stdout as the case
+// runs, --json and --csv write the collected results when all are done.
+// ops is whatever the case counts (messages, tasks, samples, paths) and
+// extra holds case specific numbers such as the error of an estimate.
+struct bench_result {
+    std::string name;
+    size_t ops;
+    double ns_per_op;
+    double allocs_per_op;
+    std::vector<std::pair<std::string, double>> extra;
+
+    double ops_per_sec() const { return ns_per_op > 0.0 ? 1e9 / ns_per_op : 0.0; }
+};
+static std::vector<bench_result> results;
+
+static void report(const std::string &name, size_t ops, bench_clock::duration elapsed,
+                   size_t allocations,
+                   std::vector<std::pair<std::string, double>> extra = {}) {
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    bench_result r{name, ops, ns / ops, static_cast<double>(allocations) / ops, std::move(extra)};
+    std::cout << name << ": " << ops << " ops, " << r.ns_per_op << " ns/op, " << r.ops_per_sec()
+              << " ops/s, " << r.allocs_per_op << " allocs/op";
+    for (const auto &[key, value] : r.extra) {
+        std::cout << ", " << key << " " << value;
+    }
+    std::cout << '\n';
+    results.push_back(std::move(r));
+}
+
+// share of each operation in a book workload, in percent
+struct book_mix {
+    int add;
+    int cancel;
+    int reduce;
+    int replace;
+};
+
+// add / cancel / reduce / cancel-replace on a book that never trades, with
+// `resting` orders spread over `levels` ticks each side of 100.00. cancels
+// and reduces pick a random live order, so on deep levels they land in the
+// middle of the queue.
+static void book_workload(const std::string &name, int resting, int levels, book_mix mix) {
+    const size_t ops = 2000000;
+    enum class op_kind { add, cancel, reduce, replace };
+    struct op {
+        op_kind kind;
+        order_id_t id;
+        order_book::side s;
+        price_t price;
+        quantity_t quantity;
+    };
+
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<int> ticks(1, levels);
+    std::uniform_int_distribution<int> sizes(1, 100);
+    std::uniform_int_distribution<int> pick(0, mix.add + mix.cancel + mix.reduce + mix.replace - 1);
+    auto passive_price = [&](order_book::side s) {
+        // bids below 100.00 and asks above it, so nothing crosses
+        price_t mid = 10000;
+        return s == order_book::side::buy ? mid - ticks(gen) : mid + ticks(gen);
+    };
+
+    // live ids in a vector so cancels and modifies always hit a resting order,
+    // adds and cancels are balanced so the book stays around its initial size
+    std::vector<order_id_t> live;
+    std::vector<op> script;
+    script.reserve(ops + resting);
+    order_id_t next_id = 1;
+    auto new_order = [&](op_kind kind, order_id_t id) {
+        order_book::side s =
+            gen() & 1 ? order_book::side::buy : order_book::side::sell;
+        return op{kind, id, s, passive_price(s), sizes(gen)};
+    };
+    for (int i = 0; i < resting; ++i) {
+        live.push_back(next_id);
+        script.push_back(new_order(op_kind::add, next_id++));
+    }
+    for (size_t i = 0; i < ops; ++i) {
+        int roll = pick(gen);
+        size_t victim = gen() % live.size();
+        if (roll < mix.add) {
+            live.push_back(next_id);
+            script.push_back(new_order(op_kind::add, next_id++));
+        } else if (roll < mix.add + mix.cancel) {
+            script.push_back(op{op_kind::cancel, live[victim], {}, 0, 0});
+            live[victim] = live.back();
+            live.pop_back();
+        } else if (roll < mix.add + mix.cancel + mix.reduce) {
+            script.push_back(op{op_kind::reduce, live[victim], {}, 0, 0});
+        } else {
+            op replacement = new_order(op_kind::replace, live[victim]);
+            script.push_back(replacement);
+        }
+    }
+
+    order_book ob(instrument{}, resting * 4);
+    auto run = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const op &o = script[i];
+            switch (o.kind) {
+            case op_kind::add:
+                ob.add_order(order_book::order(o.id, order_book::order_type::limit,
+                                               o.s, o.price, o.quantity));
+                break;
+            case op_kind::cancel:
+                ob.cancel_order(o.id);
+                break;
+            case op_kind::reduce:
+                ob.reduce_order(o.id, 1);
+                break;
+            case op_kind::replace:
+                ob.replace_order(o.id, order_book::order(o.id, order_book::order_type::limit,
+                                                         o.s, o.price, o.quantity));
+                break;
+            }
+        }
+    };
+    // the first pass fills the pools, the timed one runs on recycled memory
+    run(0, resting);
+    size_t allocations = allocation_count.load();
+    auto start = bench_clock::now();
+    run(resting, script.size());
+    auto elapsed = bench_clock::now() - start;
+    allocations = allocation_count.load() - allocations;
+    report(name, ops, elapsed, allocations);
+}
+
+// what most of a real feed looks like
+static void order_churn() { book_workload("order_churn", 10000, 50, {35, 35, 20, 10}); }
+
+// nine in ten messages are adds and cancels against levels about a
+// thousand orders deep, the cancels unlinking from the middle of the queue
+static void order_cancel_heavy() {
+    book_workload("order_cancel_heavy", 100000, 50, {45, 45, 5, 5});
+}
+
+// generated feed messages, trades included, through a single book: the
+// message rate of one matching thread
+static void book_replay() {
+    const size_t messages = 2000000;
+    feed_generator gen(7, 10000);
+    std::vector<message> feed;
+    feed.reserve(messages);
+    for (size_t i = 0; i < messages; ++i) {
+        feed.push_back(gen.next());
+    }
+    order_book ob(instrument{}, 1 << 20);
+    size_t allocations = allocation_count.load();
+    auto start = bench_clock::now();
+    for (const message &m : feed) {
+        apply(ob, m);
+    }
+    auto elapsed = bench_clock::now() - start;
+    report("book_replay", messages, elapsed, allocation_count.load() - allocations);
+}
+
+// restart cost: a book built from generated messages is written to a
+// snapshot and restored into a fresh book, both timed per resting order
+static void book_restore() {
+    const size_t messages = 4000000;
+    feed_generator gen(7, 10000);
+    order_book ob(instrument{}, 1 << 20);
+    for (size_t i = 0; i < messages; ++i) {
+        apply(ob, gen.next());
+    }
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "quant_benchmark.snapshot").string();
+    size_t allocations = allocation_count.load();
+    auto start = bench_clock::now();
+    write_snapshot(ob, path, messages);
+    auto elapsed = bench_clock::now() - start;
+    report("book_snapshot_write", ob.size(), elapsed, allocation_count.load() - allocations);
+
+    allocations = allocation_count.load();
+    start = bench_clock::now();
+    {
+        mapped_snapshot snap(path);
+        order_book restored(snap.get_instrument(), snap.size() * 2);
+        load_snapshot(restored, snap);
+        elapsed = bench_clock::now() - start;
+    }
+    report("book_snapshot_load", ob.size(), elapsed, allocation_count.load() - allocations,
+           {{"messages", static_cast<double>(messages)}});
+    std::filesystem::remove(path);
+}
+
+// the same multi-symbol flow through the sharded engine with 1, 2, 4, ...
+// shards up to the core count. the calling thread is the only producer.
+static void engine_shards() {
+    const symbol_id symbols = 64;
+    const size_t per_symbol = 100000;
+    struct routed {
+        symbol_id symbol;
+        message msg;
+    };
+    std::vector<feed_generator> generators;
+    for (symbol_id s = 0; s < symbols; ++s) {
+        generators.emplace_back(1000 + s, 10000);
+    }
+    std::vector<routed> flow;
+    flow.reserve(symbols * per_symbol);
+    for (size_t i = 0; i < per_symbol; ++i) {
+        for (symbol_id s = 0; s < symbols; ++s) {
+            flow.push_back(routed{s, generators[s].next()});
+        }
+    }
+
+    size_t max_shards = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t shards = 1; shards <= max_shards; shards *= 2) {
+        matching_engine engine(shards);
+        for (symbol_id s = 0; s < symbols; ++s) {
+            engine.add_symbol(instrument{}, 1 << 14);
+        }
+        engine.start();
+        size_t allocations = allocation_count.load();
+        auto start = bench_clock::now();
+        for (const routed &r : flow) {
+            engine.submit(r.symbol, r.msg);
+        }
+        engine.wait_until_idle();
+        auto elapsed = bench_clock::now() - start;
+        allocations = allocation_count.load() - allocations;
+        engine.stop();
+        report("engine_shards/" + std::to_string(shards), flow.size(), elapsed,
+               allocations);
+    }
+}
+
+// empty tasks measure pure scheduling overhead. external: the main thread
+// enqueues everything. nested: one root task per worker enqueues the rest
+// from inside the pool, which work stealing keeps on the local deque.
+static void pool_empty_tasks() {
+    const size_t tasks = 200000;
+    const std::pair<const char *, thread_pool::scheduling> modes[] = {
+        {"shared_queue", thread_pool::scheduling::shared_queue},
+        {"work_stealing", thread_pool::scheduling::work_stealing},
+    };
+    for (const auto &[mode_name, mode] : modes) {
+        for (size_t threads = 1; threads <= 64; threads *= 2) {
+            std::string suffix = std::string("/") + mode_name + "/" + std::to_string(threads);
+            thread_pool pool(threads, mode);
+
+            size_t allocations = allocation_count.load();
+            auto start = bench_clock::now();
+            for (size_t i = 0; i < tasks; ++i) {
+                pool.enqueue([]() {});
+            }
+            pool.wait_for_tasks();
+            auto elapsed = bench_clock::now() - start;
+            report("pool_external" + suffix, tasks, elapsed,
+                   allocation_count.load() - allocations);
+
+            allocations = allocation_count.load();
+            start = bench_clock::now();
+            for (size_t t = 0; t < threads; ++t) {
+                pool.enqueue([&pool, n = tasks / threads]() {
+                    for (size_t i = 0; i < n; ++i) {
+                        pool.enqueue([]() {});
+                    }
+                });
+            }
+            pool.wait_for_tasks();
+            elapsed = bench_clock::now() - start;
+            report("pool_nested" + suffix, tasks, elapsed,
+                   allocation_count.load() - allocations);
+        }
+    }
+}
+
+// submission cost of enqueue (future per task) against post (no future),
+// for an outside producer and for tasks spawned by the workers themselves
+static void pool_post() {
+    const size_t tasks = 1000000;
+    const std::pair<const char *, thread_pool::scheduling> modes[] = {
+        {"shared_queue", thread_pool::scheduling::shared_queue},
+        {"work_stealing", thread_pool::scheduling::work_stealing},
+    };
+    for (const auto &[mode_name, mode] : modes) {
+        for (size_t threads : {1, 4}) {
+            std::string suffix = std::string("/") + mode_name + "/" + std::to_string(threads);
+            thread_pool pool(threads, mode);
+            std::atomic<size_t> done{0};
+
+            // warm up, so the queues have grown to the backlog size
+            for (size_t i = 0; i < tasks; ++i) {
+                pool.post([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+            pool.wait_for_tasks();
+
+            size_t allocations = allocation_count.load();
+            auto start = bench_clock::now();
+            for (size_t i = 0; i < tasks; ++i) {
+                pool.enqueue([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+            pool.wait_for_tasks();
+            auto elapsed = bench_clock::now() - start;
+            report("pool_enqueue" + suffix, tasks, elapsed,
+                   allocation_count.load() - allocations);
+
+            allocations = allocation_count.load();
+            start = bench_clock::now();
+            for (size_t i = 0; i < tasks; ++i) {
+                pool.post([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+            pool.wait_for_tasks();
+            elapsed = bench_clock::now() - start;
+            report("pool_post" + suffix, tasks, elapsed,
+                   allocation_count.load() - allocations);
+
+            allocations = allocation_count.load();
+            start = bench_clock::now();
+            for (size_t t = 0; t < threads; ++t) {
+                pool.post([&pool, &done, n = tasks / threads]() {
+                    for (size_t i = 0; i < n; ++i) {
+                        pool.post([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+                    }
+                });
+            }
+            pool.wait_for_tasks();
+            elapsed = bench_clock::now() - start;
+            report("pool_post_nested" + suffix, tasks, elapsed,
+                   allocation_count.load() - allocations);
+        }
+    }
+}
+
+// submit to start latency of a single worker that has gone idle, one
+// round trip at a time, for every idle policy. the worker is pinned to the
+// last core when there is more than one. pure spin needs a core of its own
+// and is skipped on a single core machine.
+static void pool_wakeup() {
+    const size_t round_trips = 20000;
+    const std::pair<const char *, thread_pool::idle_policy> policies[] = {
+        {"block", thread_pool::idle_policy::block},
+        {"spin", thread_pool::idle_policy::spin},
+        {"spin_then_yield", thread_pool::idle_policy::spin_then_yield},
+        {"spin_then_park", thread_pool::idle_policy::spin_then_park},
+    };
+    unsigned cores = std::thread::hardware_concurrency();
+    const std::pair<const char *, thread_pool::scheduling> modes[] = {
+        {"shared_queue", thread_pool::scheduling::shared_queue},
+        {"work_stealing", thread_pool::scheduling::work_stealing},
+    };
+    for (const auto &[mode_name, mode] : modes) {
+        for (const auto &[policy_name, policy] : policies) {
+            if (policy == thread_pool::idle_policy::spin && cores < 2) {
+                continue;
+            }
+            thread_pool::options opts;
+            opts.mode = mode;
+            opts.idle = policy;
+            if (cores > 1) {
+                opts.cores = {static_cast<int>(cores - 1)};
+            }
+            thread_pool pool(1, opts);
+            std::atomic<bool> ran{false};
+            auto wakeup = std::make_unique<latency_histogram>();
+            size_t allocations = allocation_count.load();
+            auto start = bench_clock::now();
+            for (size_t i = 0; i < round_trips; ++i) {
+                ran.store(false, std::memory_order_relaxed);
+                std::uint64_t posted = latency_clock::now();
+                pool.post([&ran, &wakeup, posted]() {
+                    std::uint64_t now = latency_clock::now();
+                    wakeup->record(now > posted ? now - posted : 0);
+                    ran.store(true, std::memory_order_release);
+                });
+                while (!ran.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+            }
+            auto elapsed = bench_clock::now() - start;
+            latency_summary wake = summarize(*wakeup);
+            report(std::string("pool_wakeup/") + mode_name + "/" + policy_name, round_trips,
+                   elapsed, allocation_count.load() - allocations,
+                   {{"wakeup_p50_ns", wake.p50}, {"wakeup_p99_ns", wake.p99}});
+        }
+    }
+}
+
+// thread counts for the scaling cases: 1, 2, 4, ... up to the core count
+static std::vector<size_t> thread_counts() {
+    std::vector<size_t> counts;
+    size_t cores = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= cores; threads *= 2) {
+        counts.push_back(threads);
+    }
+    return counts;
+}
+
+// tasks per second once the pool is saturated. every task does a fixed bit
+// of integer work (about a hundred ns) and one root task per worker posts
+// its share from inside the pool, so the producer is never the bottleneck.
+static void pool_throughput() {
+    const size_t tasks = 1000000;
+    const std::pair<const char *, thread_pool::scheduling> modes[] = {
+        {"shared_queue", thread_pool::scheduling::shared_queue},
+        {"work_stealing", thread_pool::scheduling::work_stealing},
+    };
+    std::vector<std::uint64_t> out(tasks);
+    for (const auto &[mode_name, mode] : modes) {
+        for (size_t threads : thread_counts()) {
+            thread_pool pool(threads, mode);
+            auto work = [&out](size_t i) {
+                std::uint64_t state = i;
+                std::uint64_t x = 0;
+                for (int k = 0; k < 32; ++k) {
+                    x ^= splitmix64(state);
+                }
+                out[i] = x;
+            };
+            size_t allocations = allocation_count.load();
+            auto start = bench_clock::now();
+            size_t share = tasks / threads;
+            for (size_t t = 0; t < threads; ++t) {
+                size_t first = t * share;
+                size_t last = t + 1 == threads ? tasks : first + share;
+                pool.post([&pool, &work, first, last]() {
+                    for (size_t i = first; i < last; ++i) {
+                        pool.post([&work, i]() { work(i); });
+                    }
+                });
+            }
+            pool.wait_for_tasks();
+            auto elapsed = bench_clock::now() - start;
+            report(std::string("pool_throughput/") + mode_name + "/" + std::to_string(threads),
+                   tasks, elapsed, allocation_count.load() - allocations);
+        }
+    }
+}
+
+// batches of three dependent stages: a fan out of eight pieces, one task
+// that needs all of them, one that needs that. with barriers the pool
+// drains after every stage of every batch, as a task graph the batches
+// overlap and the only wait is at the end.
+static void pool_pipeline() {
+    const size_t batches = 20000;
+    const size_t width = 8;
+    auto work = [](std::uint64_t seed) {
+        std::uint64_t x = 0;
+        for (int k = 0; k < 64; ++k) {
+            x ^= splitmix64(seed);
+        }
+        return x;
+    };
+    const std::pair<const char *, thread_pool::scheduling> modes[] = {
+        {"shared_queue", thread_pool::scheduling::shared_queue},
+        {"work_stealing", thread_pool::scheduling::work_stealing},
+    };
+    for (const auto &[mode_name, mode] : modes) {
+        for (size_t threads : thread_counts()) {
+            std::string suffix = std::string("/") + mode_name + "/" + std::to_string(threads);
+            thread_pool pool(threads, mode);
+            std::vector<std::uint64_t> out(batches * (width + 2));
+
+            size_t allocations = allocation_count.load();
+            auto start = bench_clock::now();
+            for (size_t b = 0; b < batches; ++b) {
+                std::uint64_t *slots = &out[b * (width + 2)];
+                for (size_t i = 0; i < width; ++i) {
+                    pool.post([slots, i, &work]() { slots[i] = work(i); });
+                }
+                pool.wait_for_tasks();
+                pool.post([slots, &work]() { slots[width] = work(slots[0]); });
+                pool.wait_for_tasks();
+                pool.post([slots, &work]() { slots[width + 1] = work(slots[width]); });
+                pool.wait_for_tasks();
+            }
+            auto elapsed = bench_clock::now() - start;
+            report("pool_pipeline_barrier" + suffix, batches, elapsed,
+                   allocation_count.load() - allocations);
+
+            allocations = allocation_count.load();
+            start = bench_clock::now();
+            {
+                thread_pool::task_group group(pool);
+                std::vector<thread_pool::task_handle> pieces(width);
+                for (size_t b = 0; b < batches; ++b) {
+                    std::uint64_t *slots = &out[b * (width + 2)];
+                    for (size_t i = 0; i < width; ++i) {
+                        pieces[i] = group.run([slots, i, &work]() { slots[i] = work(i); });
+                    }
+                    group.run_after(pieces, [slots, &work]() { slots[width] = work(slots[0]); })
+                        .then([slots, &work]() { slots[width + 1] = work(slots[width]); });
+                }
+                group.wait();
+            }
+            elapsed = bench_clock::now() - start;
+            report("pool_pipeline_graph" + suffix, batches, elapsed,
+                   allocation_count.load() - allocations);
+        }
+    }
+}
+
+// monte carlo samples per second on the pool: π points and 52 step
+// european call paths, pseudo random, one to all cores
+static void mc_throughput() {
+    const std::uint64_t points = std::uint64_t{1} << 27;
+    const std::uint64_t paths = std::uint64_t{1} << 18;
+    gbm_model model;
+    time_grid grid{1.0, 52};
+    european_payoff call{option_kind::call, 100.0};
+    for (size_t threads : thread_counts()) {
+        thread_pool pool(threads, thread_pool::scheduling::work_stealing);
+        block_stream stream(42, 0);
+        size_t allocations = allocation_count.load();
+        auto start = bench_clock::now();
+        running_stats pi = pool.parallel_reduce(
+            size_t{0}, static_cast<size_t>(points), running_stats{},
+            [&stream](size_t begin, size_t end, running_stats &acc) {
+                sample_pi(stream, begin, end - begin, acc);
+            },
+            [](running_stats a, const running_stats &b) {
+                a.merge(b);
+                return a;
+            },
+            size_t{1} << 20);
+        auto elapsed = bench_clock::now() - start;
+        report("mc_throughput/pi/" + std::to_string(threads), points, elapsed,
+               allocation_count.load() - allocations, {{"estimate", pi.mean}});
+
+        point_set pseudo(sampling_mode::pseudo, 42);
+        allocations = allocation_count.load();
+        start = bench_clock::now();
+        running_stats value = price(pool, model, grid, call, paths, pseudo);
+        elapsed = bench_clock::now() - start;
+        report("mc_throughput/option_paths/" + std::to_string(threads), paths, elapsed,
+               allocation_count.load() - allocations, {{"estimate", value.mean}});
+    }
+}
+
+// single thread π sampling: the original per point mt19937 path with the
+// coordinates truncated to int, against the batched kernel. hits are
+// printed so the bias of the old path is visible next to the speed.
+static void mc_pi() {
+    const size_t samples = 20000000;
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis(1, 960);
+    const int r = 480;
+    size_t hits = 0;
+    size_t allocations = allocation_count.load();
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < samples; ++i) {
+        long double x = dis(gen) - r;
+        long double y = dis(gen) - r;
+        int xi = static_cast<int>(x);
+        int yi = static_cast<int>(y);
+        hits += xi * xi + yi * yi <= r * r;
+    }
+    auto elapsed = bench_clock::now() - start;
+    report("mc_pi/mt19937_scalar", samples, elapsed, allocation_count.load() - allocations);
+    std::cout << "  pi = " << 4.0 * static_cast<double>(hits) / samples << "\n";
+
+    xoshiro_lanes<> rng(42);
+    allocations = allocation_count.load();
+    start = bench_clock::now();
+    std::uint64_t kernel_hits = sample_quarter_circle(rng, samples);
+    elapsed = bench_clock::now() - start;
+    report("mc_pi/xoshiro_batched", samples, elapsed, allocation_count.load() - allocations);
+    std::cout << "  pi = " << 4.0 * static_cast<double>(kernel_hits) / samples << "\n";
+
+    // reproducible version, split into uneven pieces on purpose: the hit
+    // count has to match a single pass exactly
+    block_stream stream(42, 0);
+    allocations = allocation_count.load();
+    start = bench_clock::now();
+    std::uint64_t stream_hits = sample_quarter_circle(stream, 0, samples);
+    elapsed = bench_clock::now() - start;
+    report("mc_pi/block_stream", samples, elapsed, allocation_count.load() - allocations);
+    std::uint64_t split_hits = 0;
+    for (std::uint64_t first = 0, piece = 777; first < samples; first += piece, piece += 4099) {
+        split_hits += sample_quarter_circle(stream, first, std::min<std::uint64_t>(piece, samples - first));
+    }
+    std::cout << "  pi = " << 4.0 * static_cast<double>(stream_hits) / samples
+              << (split_hits == stream_hits ? ", identical when split\n" : ", SPLIT MISMATCH\n");
+}
+
+// error against wall clock for every sampling mode. each estimate is
+// repeated over independent seeds and the rms error against the known
+// answer is reported with the mean time of one run. efficiency is the
+// pseudo random error^2 * time over the mode's at the same number of
+// points: how many times less work the mode needs for the same error.
+struct sampling_case {
+    const char *name;
+    sampling_mode mode;
+    bool control;
+};
+
+static const sampling_case sampling_cases[] = {
+    {"pseudo", sampling_mode::pseudo, false},
+    {"antithetic", sampling_mode::antithetic, false},
+    {"control_variate", sampling_mode::pseudo, true},
+    {"stratified", sampling_mode::stratified, false},
+    {"sobol", sampling_mode::sobol, false},
+    {"halton", sampling_mode::halton, false},
+};
+
+template <class F>
+static void sampling_sweep(const std::string &prefix, const std::vector<size_t> &sizes,
+                           size_t repeats, double exact, F &&estimate) {
+    for (size_t points : sizes) {
+        double pseudo_work = 0.0;
+        for (const sampling_case &c : sampling_cases) {
+            double square_error = 0.0;
+            bench_clock::duration elapsed{};
+            size_t allocations = allocation_count.load();
+            for (size_t r = 0; r < repeats; ++r) {
+                auto start = bench_clock::now();
+                double value = estimate(c, points, 1000 + r);
+                elapsed += bench_clock::now() - start;
+                square_error += (value - exact) * (value - exact);
+            }
+            allocations = allocation_count.load() - allocations;
+            double rmse = std::sqrt(square_error / repeats);
+            double ms = std::chrono::duration<double, std::milli>(elapsed).count() / repeats;
+            double work = rmse * rmse * ms;
+            if (c.mode == sampling_mode::pseudo && !c.control) {
+                pseudo_work = work;
+            }
+            // ops are the points of all repeats, so ns/op is per point
+            report(prefix + c.name + "/" + std::to_string(points), points * repeats, elapsed,
+                   allocations, {{"rmse", rmse}, {"efficiency", pseudo_work / work}});
+        }
+    }
+}
+
+// π on one thread, groups sized so every estimate has at least 32
+static void mc_sampling() {
+    sampling_sweep("mc_sampling/", {1 << 16, 1 << 20, 1 << 24}, 16, 3.14159265358979323846,
+                   [](const sampling_case &c, size_t points, std::uint64_t seed) {
+                       point_set set(c.mode, seed, std::clamp<size_t>(points / 32, 1024, 1 << 16));
+                       control_variate control = c.control ? pi_control(seed) : control_variate{};
+                       running_stats stats;
+                       sample_pi(set, 0, points / set.group_size(), stats, control);
+                       return stats.mean;
+                   });
+}
+
+// a one year at the money european call on 52 weekly steps against
+// black-scholes, through the path engine on a one thread pool
+static void option_sampling() {
+    thread_pool pool(1);
+    gbm_model model;
+    model.rate = 0.03;
+    time_grid grid{1.0, 52};
+    european_payoff call{option_kind::call, 100.0};
+    sampling_sweep("option_sampling/", {1 << 14, 1 << 18}, 8,
+                   black_scholes(model, grid.maturity, option_kind::call, 100.0),
+                   [&](const sampling_case &c, size_t paths, std::uint64_t seed) {
+                       point_set set(c.mode, seed, std::clamp<size_t>(paths / 32, 256, 4096));
+                       control_variate control = c.control ? spot_control(model, grid, call, seed) : control_variate{};
+                       return price(pool, model, grid, call, paths, set, control).mean;
+                   });
+}
+
+// a short description of the build, so results from different machines or
+// flags are not compared by accident
+static std::string build_flags() {
+#if defined(__OPTIMIZE__)
+    std::string flags = "optimized";
+#else
+    std::string flags = "unoptimized";
+#endif
+#if defined(__AVX512F__)
+    flags += " avx512";
+#elif defined(__AVX2__)
+    flags += " avx2";
+#endif
+    if (latency_enabled) {
+        flags += " instrumented";
+    }
+    return flags;
+}
+
+static void write_json(std::ostream &out, const std::string &label) {
+    auto quoted = [](const std::string &text) {
+        std::string q = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                q += '\\';
+            }
+            q += c;
+        }
+        return q + '"';
+    };
+    out << std::setprecision(9) << "{\n  \"label\": " << quoted(label)
+        << ",\n  \"compiler\": " << quoted(__VERSION__)
+        << ",\n  \"build\": " << quoted(build_flags())
+        << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result &r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": " << quoted(r.name) << ", \"ops\": " << r.ops
+            << ", \"ns_per_op\": " << r.ns_per_op << ", \"ops_per_sec\": " << r.ops_per_sec()
+            << ", \"allocs_per_op\": " << r.allocs_per_op;
+        for (const auto &[key, value] : r.extra) {
+            out << ", " << quoted(key) << ": " << value;
+        }
+        out << '}';
+    }
+    out << "\n  ]\n}\n";
+}
+
+// one row per result, the case specific numbers get a column each and stay
+// empty for the cases that do not have them
+static void write_csv(std::ostream &out) {
+    std::vector<std::string> extra_columns;
+    for (const bench_result &r : results) {
+        for (const auto &[key, value] : r.extra) {
+            if (std::find(extra_columns.begin(), extra_columns.end(), key) == extra_columns.end()) {
+                extra_columns.push_back(key);
+            }
+        }
+    }
+    out << std::setprecision(9) << "name,ops,ns_per_op,ops_per_sec,allocs_per_op";
+    for (const std::string &column : extra_columns) {
+        out << ',' << column;
+    }
+    out << '\n';
+    for (const bench_result &r : results) {
+        out << r.name << ',' << r.ops << ',' << r.ns_per_op << ',' << r.ops_per_sec() << ','
+            << r.allocs_per_op;
+        for (const std::string &column : extra_columns) {
+            out << ',';
+            for (const auto &[key, value] : r.extra) {
+                if (key == column) {
+                    out << value;
+                }
+            }
+        }
+        out << '\n';
+    }
+}
+
+// ns/op of this run against a csv written by an earlier one. cases slower by
+// more than threshold percent are regressions and make the run fail.
+static bool compare_with(const std::string &path, double threshold) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("cannot open baseline " + path);
+    }
+    std::string line;
+    std::getline(in, line);
+    std::vector<std::string> header;
+    {
+        std::stringstream fields(line);
+        for (std::string field; std::getline(fields, field, ',');) {
+            header.push_back(field);
+        }
+    }
+    auto column = std::find(header.begin(), header.end(), "ns_per_op") - header.begin();
+    if (header.empty() || header[0] != "name" || column == static_cast<std::ptrdiff_t>(header.size())) {
+        throw std::runtime_error(path + " is not a benchmark csv");
+    }
+    std::vector<std::pair<std::string, double>> baseline;
+    while (std::getline(in, line)) {
+        std::stringstream fields(line);
+        std::vector<std::string> row;
+        for (std::string field; std::getline(fields, field, ',');) {
+            row.push_back(field);
+        }
+        if (static_cast<std::ptrdiff_t>(row.size()) > column) {
+            baseline.emplace_back(row[0], std::stod(row[column]));
+        }
+    }
+
+    size_t regressions = 0;
+    std::cout << "\nagainst " << path << ":\n";
+    for (const bench_result &r : results) {
+        auto old = std::find_if(baseline.begin(), baseline.end(),
+                                [&r](const auto &b) { return b.first == r.name; });
+        if (old == baseline.end() || old->second <= 0.0) {
+            continue;
+        }
+        double change = 100.0 * (r.ns_per_op / old->second - 1.0);
+        bool regressed = change > threshold;
+        regressions += regressed;
+        std::cout << r.name << ": " << old->second << " -> " << r.ns_per_op << " ns/op, "
+                  << std::showpos << change << std::noshowpos << "%"
+                  << (regressed ? "  REGRESSION\n" : "\n");
+    }
+    std::cout << regressions << " regression(s) over " << threshold << "%\n";
+    return regressions == 0;
+}
+
+int main(int argc, char **argv) {
+    const std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+        {"order_churn", order_churn},
+        {"order_cancel_heavy", order_cancel_heavy},
+        {"book_replay", book_replay},
+        {"book_restore", book_restore},
+        {"engine_shards", engine_shards},
+        {"pool_empty_tasks", pool_empty_tasks},
+        {"pool_post", pool_post},
+        {"pool_throughput", pool_throughput},
+        {"pool_wakeup", pool_wakeup},
+        {"pool_pipeline", pool_pipeline},
+        {"mc_pi", mc_pi},
+        {"mc_throughput", mc_throughput},
+        {"mc_sampling", mc_sampling},
+        {"option_sampling", option_sampling},
+    };
+    const std::string usage =
+        "usage: benchmark [case ...] [--json file] [--csv file] [--label text]\n"
+        "                 [--compare baseline.csv] [--threshold percent] [--list]\n";
+
+    std::vector<std::string> selected;
+    std::string json_path, csv_path, baseline_path, label;
+    double threshold = 10.0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            for (const auto &entry : benchmarks) {
+                std::cout << entry.first << '\n';
+            }
+            return 0;
+        }
+        if (arg.rfind("--", 0) == 0) {
+            if (i + 1 == argc) {
+                std::cerr << usage;
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (arg == "--json") {
+                json_path = value;
+            } else if (arg == "--csv") {
+                csv_path = value;
+            } else if (arg == "--label") {
+                label = value;
+            } else if (arg == "--compare") {
+                baseline_path = value;
+            } else if (arg == "--threshold") {
+                threshold = std::stod(value);
+            } else {
+                std::cerr << usage;
+                return 1;
+            }
+            continue;
+        }
+        auto known = std::find_if(benchmarks.begin(), benchmarks.end(),
+                                  [&arg](const auto &entry) { return entry.first == arg; });
+        if (known == benchmarks.end()) {
+            std::cerr << "unknown case " << arg << "\n" << usage;
+            return 1;
+        }
+        selected.push_back(arg);
+    }
+
+    for (const auto &[name, run] : benchmarks) {
+        if (selected.empty() || std::find(selected.begin(), selected.end(), name) != selected.end()) {
+            run();
+        }
+    }
+    // built with -DQUANT_INSTRUMENTATION: book and pool latency over all cases
+    if constexpr (latency_enabled) {
+        latency_report(std::cout);
+    }
+
+    try {
+        if (!json_path.empty()) {
+            std::ofstream out(json_path);
+            write_json(out, label);
+        }
+        if (!csv_path.empty()) {
+            std::ofstream out(csv_path);
+            write_csv(out);
+        }
+        if (!baseline_path.empty() && !compare_with(baseline_path, threshold)) {
+            return 2;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "instrument.hpp"
+#include "spsc_ring.hpp"
+
+enum class event_type : std::uint8_t { ack, fill, cancel, reject };
+
+enum class reject_reason : std::uint8_t {
+    none,
+    duplicate_id,
+    unknown_order,
+    invalid_quantity,
+    // limit price outside the instrument's price band
+    price_out_of_band,
+    // replacement on the other side of the order it replaces
+    side_mismatch
+};
+
+// fixed size binary record for everything the book reports. for a fill,
+// order_id is the aggressor, match_id the resting order and price/quantity
+// the execution. ack and cancel carry the open quantity of the order.
+struct event {
+    order_id_t order_id;
+    order_id_t match_id;
+    quantity_t quantity;
+    price_t price;
+    event_type type;
+    // order_book::side of order_id, 0 buy and 1 sell
+    std::uint8_t side;
+    reject_reason reason;
+};
+static_assert(sizeof(event) == 32);
+
+enum class depth_update_type : std::uint8_t { changed, removed };
+
+// aggregated state of one price level after it changed, quantity and
+// orders are zero when the level was removed
+struct depth_update {
+    quantity_t quantity;
+    price_t price;
+    std::uint32_t orders;
+    depth_update_type type;
+    // order_book::side of the level, 0 buy and 1 sell
+    std::uint8_t side;
+};
+static_assert(sizeof(depth_update) == 24);
+
+// where the book sends its records, called on the matching thread so
+// implementations must not block
+template <class record_t> class sink {
+  public:
+    virtual ~sink() = default;
+    virtual void publish(const record_t &r) = 0;
+};
+
+// records go into a lock-free ring for another thread to consume. if the
+// consumer falls behind the record is counted as dropped rather than
+// stalling the book.
+template <class record_t> class ring_sink : public sink<record_t> {
+  public:
+    explicit ring_sink(size_t capacity = 1 << 16) : ring(capacity) {}
+
+    void publish(const record_t &r) override {
+        if (!ring.try_push(r)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_pop(record_t &r) { return ring.try_pop(r); }
+    bool drained() const { return ring.popped() == ring.pushed(); }
+    size_t dropped_records() const { return dropped.load(std::memory_order_relaxed); }
+
+  private:
+    spsc_ring<record_t> ring;
+    std::atomic<size_t> dropped{0};
+};
+
+// appends raw records to a file, batch_size records per write
+template <class record_t> class file_sink : public sink<record_t> {
+  public:
+    explicit file_sink(const char *path, size_t batch_size = 4096)
+        : file(std::fopen(path, "wb")) {
+        if (!file) {
+            throw std::runtime_error("cannot open record file");
+        }
+        batch.reserve(batch_size);
+    }
+
+    file_sink(const file_sink &) = delete;
+    file_sink &operator=(const file_sink &) = delete;
+
+    ~file_sink() override {
+        flush();
+        std::fclose(file);
+    }
+
+    void publish(const record_t &r) override {
+        batch.push_back(r);
+        if (batch.size() == batch.capacity()) {
+            flush();
+        }
+    }
+
+    void flush() {
+        std::fwrite(batch.data(), sizeof(record_t), batch.size(), file);
+        batch.clear();
+    }
+
+  private:
+    std::FILE *file;
+    std::vector<record_t> batch;
+};
+
+using event_sink = sink<event>;
+using ring_event_sink = ring_sink<event>;
+using file_event_sink = file_sink<event>;
+using depth_sink = sink<depth_update>;
+using ring_depth_sink = ring_sink<depth_update>;
+
+// human readable form of an event
+inline void format_event(std::ostream &out, const event &e,
+                         const instrument &inst) {
+    switch (e.type) {
+    case event_type::ack:
+        out << "Accepted Order ID: " << e.order_id << " quantity: " << e.quantity;
+        break;
+    case event_type::fill:
+        out << "Matched Order ID: " << e.order_id << " with Order ID: " << e.match_id
+            << " at Price: " << std::fixed << std::setprecision(2)
+            << inst.to_price(e.price) << " quantity: " << e.quantity;
+        break;
+    case event_type::cancel:
+        out << "Canceled Order ID : " << e.order_id;
+        break;
+    case event_type::reject:
+        out << "Rejected Order ID: " << e.order_id
+            << " reason: " << static_cast<int>(e.reason);
+        break;
+    }
+    out << '\n';
+}
+
+// consumer thread that drains a ring_event_sink and formats the events, so
+// the formatting and the stream writes stay off the matching thread
+class event_printer {
+  public:
+    event_printer(ring_event_sink &source, std::ostream &out,
+                  const instrument &inst)
+        : source(source), out(out), inst(inst),
+          worker([this]() { run(); }) {}
+
+    event_printer(const event_printer &) = delete;
+    event_printer &operator=(const event_printer &) = delete;
+
+    ~event_printer() {
+        stop.store(true, std::memory_order_release);
+        worker.join();
+    }
+
+    // wait until every event published so far has been written out
+    void wait_until_drained() const {
+        while (!source.drained() || busy.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+
+  private:
+    ring_event_sink &source;
+    std::ostream &out;
+    instrument inst;
+    std::atomic<bool> stop{false};
+    std::atomic<bool> busy{false};
+    std::thread worker;
+
+    void run() {
+        event e;
+        while (true) {
+            busy.store(true, std::memory_order_release);
+            bool any = false;
+            while (source.try_pop(e)) {
+                format_event(out, e, inst);
+                any = true;
+            }
+            if (any) {
+                out.flush();
+            }
+            busy.store(false, std::memory_order_release);
+            if (stop.load(std::memory_order_acquire) && source.drained()) {
+                return;
+            }
+            if (!any) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+};
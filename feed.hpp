@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "instrument.hpp"
+#include "mapped_file.hpp"
+#include "order_book.hpp"
+
+// binary market data feed: a fixed header followed by fixed size messages,
+// laid out so a mapped file can be read in place without parsing
+
+enum class message_type : std::uint8_t { add, cancel, modify, market };
+
+// add: new order with price, quantity, side and order type
+// cancel: order_id only
+// modify: new price and quantity for a resting order
+// market: market order for quantity on side
+struct message {
+    order_id_t order_id;
+    quantity_t quantity;
+    price_t price;
+    message_type type;
+    order_book::side side;
+    order_book::order_type order_type;
+};
+static_assert(sizeof(message) == 24);
+
+struct feed_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t count;
+    double tick_size;
+    double lot_size;
+};
+static_assert(sizeof(feed_header) == 32);
+
+constexpr char feed_magic[4] = {'Q', 'P', 'F', 'D'};
+constexpr std::uint32_t feed_version = 1;
+
+// a mapped file is used without parsing, so a corrupt or hostile message can
+// carry any byte in its enum fields. they are range checked before the book
+// switches on them.
+inline bool valid(const message &m) {
+    return m.type <= message_type::market && m.side <= order_book::side::sell &&
+           m.order_type <= order_book::order_type::immediate_or_cancel;
+}
+
+// push one message through the book. a message that is not valid() is
+// dropped and false returned.
+inline bool apply(order_book &ob, const message &m) {
+    if (!valid(m)) {
+        return false;
+    }
+    switch (m.type) {
+    case message_type::add:
+        ob.add_order(order_book::order(m.order_id, m.order_type, m.side, m.price,
+                                       m.quantity));
+        break;
+    case message_type::cancel:
+        ob.cancel_order(m.order_id);
+        break;
+    case message_type::modify:
+        ob.modify_order(m.order_id, m.price, m.quantity);
+        break;
+    case message_type::market:
+        ob.add_order(order_book::order(m.order_id, order_book::order_type::market,
+                                       m.side, 0, m.quantity));
+        break;
+    }
+    return true;
+}
+
+// buffered writer, the message count in the header is filled in on close
+class feed_writer {
+  public:
+    feed_writer(const std::string &path, const instrument &inst,
+                size_t batch_size = 1 << 14)
+        : file(std::fopen(path.c_str(), "wb")) {
+        if (!file) {
+            throw std::runtime_error("cannot create feed file " + path);
+        }
+        std::memcpy(header.magic, feed_magic, sizeof(feed_magic));
+        header.version = feed_version;
+        header.count = 0;
+        header.tick_size = inst.tick_size;
+        header.lot_size = inst.lot_size;
+        std::fwrite(&header, sizeof(header), 1, file);
+        batch.reserve(batch_size);
+    }
+
+    feed_writer(const feed_writer &) = delete;
+    feed_writer &operator=(const feed_writer &) = delete;
+
+    ~feed_writer() {
+        flush();
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, file);
+        std::fclose(file);
+    }
+
+    void write(const message &m) {
+        batch.push_back(m);
+        ++header.count;
+        if (batch.size() == batch.capacity()) {
+            flush();
+        }
+    }
+
+  private:
+    std::FILE *file;
+    feed_header header{};
+    std::vector<message> batch;
+
+    void flush() {
+        std::fwrite(batch.data(), sizeof(message), batch.size(), file);
+        batch.clear();
+    }
+};
+
+// read only mapping of a feed file, messages are used straight from the
+// page cache
+class mapped_feed {
+  public:
+    explicit mapped_feed(const std::string &path)
+        : file(path, "feed", sizeof(feed_header)) {
+        const feed_header &h = header();
+        if (std::memcmp(h.magic, feed_magic, sizeof(feed_magic)) != 0 ||
+            h.version != feed_version ||
+            h.count > (file.size() - sizeof(feed_header)) / sizeof(message)) {
+            throw std::runtime_error("not a feed file " + path);
+        }
+    }
+
+    const feed_header &header() const {
+        return *reinterpret_cast<const feed_header *>(file.bytes());
+    }
+    instrument get_instrument() const {
+        instrument inst;
+        inst.tick_size = header().tick_size;
+        inst.lot_size = header().lot_size;
+        return inst;
+    }
+
+    const message *begin() const {
+        return reinterpret_cast<const message *>(file.bytes() + sizeof(feed_header));
+    }
+    const message *end() const { return begin() + header().count; }
+    size_t size() const { return header().count; }
+
+  private:
+    mapped_file file;
+};
+
+// share of each message type in a generated feed, the rest are market orders
+struct feed_mix {
+    double add{0.50};
+    double cancel{0.35};
+    double modify{0.10};
+};
+
+// synthetic order flow. the mid price does a random walk, passive orders
+// are placed a geometric number of ticks away from it so depth piles up near
+// the top of book, sizes are log-normal in lots. cancels and modifies pick a
+// random order the generator still believes is live (some of them will have
+// been filled by then, like on a real feed).
+class feed_generator {
+  public:
+    feed_generator(std::uint64_t seed, price_t start_mid,
+                   feed_mix weights = feed_mix{})
+        : gen(seed), mid(start_mid), weights(weights) {}
+
+    message next() {
+        double roll = unit(gen);
+        if (live.empty() || roll < weights.add) {
+            return add();
+        }
+        roll -= weights.add;
+        if (roll < weights.cancel) {
+            return cancel();
+        }
+        roll -= weights.cancel;
+        if (roll < weights.modify) {
+            return modify();
+        }
+        return market();
+    }
+
+  private:
+    std::mt19937_64 gen;
+    price_t mid;
+    feed_mix weights;
+    order_id_t next_id{1};
+    std::vector<std::pair<order_id_t, order_book::side>> live;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+    std::geometric_distribution<price_t> depth{0.2};
+    std::lognormal_distribution<double> size{3.0, 1.0};
+    std::bernoulli_distribution coin{0.5};
+
+    quantity_t draw_size() {
+        return std::max<quantity_t>(1, static_cast<quantity_t>(size(gen)));
+    }
+
+    order_book::side draw_side() {
+        return coin(gen) ? order_book::side::buy : order_book::side::sell;
+    }
+
+    price_t passive_price(order_book::side s) {
+        // at least one tick away from the mid
+        price_t offset = 1 + depth(gen);
+        return s == order_book::side::buy ? mid - offset : mid + offset;
+    }
+
+    message add() {
+        // drift the mid now and then
+        if (unit(gen) < 0.05) {
+            mid += coin(gen) ? 1 : -1;
+        }
+        order_book::side s = draw_side();
+        price_t price = passive_price(s);
+        order_book::order_type type = order_book::order_type::limit;
+        // a few limit orders are marketable, a third each of them plain
+        // limit, immediate or cancel and fill or kill
+        if (unit(gen) < 0.02) {
+            price = s == order_book::side::buy ? mid + 2 : mid - 2;
+            double kind = unit(gen);
+            if (kind < 1.0 / 3) {
+                type = order_book::order_type::immediate_or_cancel;
+            } else if (kind < 2.0 / 3) {
+                type = order_book::order_type::for_or_kill_limit;
+            }
+        }
+        message m{next_id++, draw_size(), price, message_type::add, s, type};
+        live.emplace_back(m.order_id, s);
+        return m;
+    }
+
+    size_t pick_live() {
+        return std::uniform_int_distribution<size_t>(0, live.size() - 1)(gen);
+    }
+
+    message cancel() {
+        size_t i = pick_live();
+        message m{live[i].first, 0, 0, message_type::cancel, live[i].second,
+                  order_book::order_type::limit};
+        live[i] = live.back();
+        live.pop_back();
+        return m;
+    }
+
+    message modify() {
+        size_t i = pick_live();
+        order_book::side s = live[i].second;
+        return message{live[i].first, draw_size(), passive_price(s),
+                       message_type::modify, s, order_book::order_type::limit};
+    }
+
+    message market() {
+        return message{next_id++, draw_size(), 0, message_type::market,
+                       draw_side(), order_book::order_type::market};
+    }
+};
@@ -0,0 +1,183 @@
+// replay a binary feed through the order book as fast as possible
+// build: cmake --build build/native --target feed_replay, the instrumented
+// preset adds add / cancel / match histograms from inside the book
+// usage: feed_replay generate <file> <messages> [seed]
+//        feed_replay replay <file> [events file]
+//        feed_replay snapshot <file> <messages> <snapshot> <journal>
+//        feed_replay restart <snapshot> <journal> [file]
+#include "feed.hpp"
+#include "latency.hpp"
+#include "snapshot.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+
+using replay_clock = std::chrono::steady_clock;
+
+static int generate(const std::string &path, size_t count, std::uint64_t seed) {
+    const instrument inst{};
+    feed_writer out(path, inst);
+    feed_generator gen(seed, inst.to_ticks(100.0));
+    for (size_t i = 0; i < count; ++i) {
+        out.write(gen.next());
+    }
+    std::cout << "wrote " << count << " messages to " << path << '\n';
+    return 0;
+}
+
+static int replay(const std::string &path, const char *events_path) {
+    mapped_feed feed(path);
+    const instrument inst = feed.get_instrument();
+    const size_t count = feed.size();
+    std::unique_ptr<file_event_sink> events;
+    if (events_path) {
+        events = std::make_unique<file_event_sink>(events_path);
+    }
+
+    // first pass: throughput, nothing but the book in the loop
+    {
+        order_book ob(inst, 1 << 20);
+        ob.set_event_sink(events.get());
+        auto start = replay_clock::now();
+        for (const message &m : feed) {
+            apply(ob, m);
+        }
+        double seconds = std::chrono::duration<double>(replay_clock::now() - start).count();
+        std::cout << "messages: " << count << '\n'
+                  << "seconds: " << seconds << '\n'
+                  << "messages/sec: " << static_cast<double>(count) / seconds << '\n'
+                  << "resting orders at end: " << ob.size() << '\n';
+    }
+
+    // the book's own histograms cover the throughput pass only
+    if constexpr (latency_enabled) {
+        latency_report(std::cout);
+        latency_registry::instance().reset();
+    }
+
+    // second pass on a fresh book: time every message on its own
+    auto latency = std::make_unique<latency_histogram>();
+    {
+        order_book ob(inst, 1 << 20);
+        for (const message &m : feed) {
+            std::uint64_t start = latency_clock::now();
+            apply(ob, m);
+            latency->record(latency_clock::now() - start);
+        }
+    }
+    if (latency->count() == 0) {
+        return 0;
+    }
+    std::cout << "message " << summarize(*latency) << '\n';
+    return 0;
+}
+
+// apply the first `messages` of a feed, snapshot the book and write the
+// rest of the feed to a journal, the state a live process would leave
+// behind if it stopped there
+static int snapshot(const std::string &path, size_t messages, const std::string &snapshot_path,
+                    const std::string &journal_path) {
+    mapped_feed feed(path);
+    const instrument inst = feed.get_instrument();
+    messages = std::min(messages, feed.size());
+    order_book ob(inst, 1 << 20);
+    for (const message *m = feed.begin(); m != feed.begin() + messages; ++m) {
+        apply(ob, *m);
+    }
+    auto start = replay_clock::now();
+    write_snapshot(ob, snapshot_path, messages);
+    double seconds = std::chrono::duration<double>(replay_clock::now() - start).count();
+    feed_writer journal(journal_path, inst);
+    for (const message *m = feed.begin() + messages; m != feed.end(); ++m) {
+        journal.write(*m);
+    }
+    std::cout << "snapshot after " << messages << " messages: " << ob.size()
+              << " resting orders in " << seconds * 1e3 << " ms\n"
+              << "journal: " << feed.size() - messages << " messages\n";
+    return 0;
+}
+
+// every resting order in snapshot order, for comparing two books
+static std::vector<std::tuple<order_id_t, quantity_t, price_t>> resting_orders(const order_book &ob) {
+    std::vector<std::tuple<order_id_t, quantity_t, price_t>> orders;
+    ob.for_each_order([&orders](const order_book::order &o) {
+        orders.emplace_back(o.get_id(), o.get_quantity(), o.get_price());
+    });
+    return orders;
+}
+
+// restore a snapshot and replay its journal on top. given the full feed it
+// also replays that from the start and checks both books hold the same
+// orders in the same queue positions.
+static int restart(const std::string &snapshot_path, const std::string &journal_path,
+                   const char *full_path) {
+    auto start = replay_clock::now();
+    mapped_snapshot snap(snapshot_path);
+    order_book ob(snap.get_instrument(), std::max<size_t>(snap.size() * 2, 1 << 16));
+    load_snapshot(ob, snap);
+    double load_seconds = std::chrono::duration<double>(replay_clock::now() - start).count();
+
+    start = replay_clock::now();
+    mapped_feed journal(journal_path);
+    for (const message &m : journal) {
+        apply(ob, m);
+    }
+    double journal_seconds = std::chrono::duration<double>(replay_clock::now() - start).count();
+    std::cout << "snapshot: " << snap.size() << " orders at message " << snap.sequence()
+              << ", loaded in " << load_seconds * 1e3 << " ms\n"
+              << "journal: " << journal.size() << " messages in " << journal_seconds * 1e3
+              << " ms\n"
+              << "restart: " << (load_seconds + journal_seconds) * 1e3 << " ms, "
+              << ob.size() << " resting orders\n";
+    if (!full_path) {
+        return 0;
+    }
+
+    start = replay_clock::now();
+    mapped_feed feed(full_path);
+    order_book full(feed.get_instrument(), 1 << 20);
+    for (const message &m : feed) {
+        apply(full, m);
+    }
+    double full_seconds = std::chrono::duration<double>(replay_clock::now() - start).count();
+    bool same = resting_orders(ob) == resting_orders(full);
+    std::cout << "full replay: " << feed.size() << " messages in " << full_seconds * 1e3
+              << " ms, books " << (same ? "match" : "DIFFER") << '\n';
+    return same ? 0 : 2;
+}
+
+int main(int argc, char **argv) {
+    const std::string usage =
+        "usage: feed_replay generate <file> <messages> [seed]\n"
+        "       feed_replay replay <file> [events file]\n"
+        "       feed_replay snapshot <file> <messages> <snapshot> <journal>\n"
+        "       feed_replay restart <snapshot> <journal> [file]\n";
+    if (argc < 3) {
+        std::cerr << usage;
+        return 1;
+    }
+    const std::string command = argv[1];
+    try {
+        if (command == "generate" && argc >= 4) {
+            std::uint64_t seed = argc >= 5 ? std::stoull(argv[4]) : 1;
+            return generate(argv[2], std::stoull(argv[3]), seed);
+        }
+        if (command == "replay") {
+            return replay(argv[2], argc >= 4 ? argv[3] : nullptr);
+        }
+        if (command == "snapshot" && argc >= 6) {
+            return snapshot(argv[2], std::stoull(argv[3]), argv[4], argv[5]);
+        }
+        if (command == "restart" && argc >= 4) {
+            return restart(argv[2], argv[3], argc >= 5 ? argv[4] : nullptr);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::cerr << usage;
+    return 1;
+}
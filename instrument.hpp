@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// prices are whole ticks and quantities whole lots inside the book, doubles
+// only exist at the edges (order entry, printing)
+using price_t = std::int32_t;
+using quantity_t = std::int64_t;
+using order_id_t = std::uint64_t;
+
+// per instrument trading parameters and the conversions between external
+// decimal values and the book's integer representation
+struct instrument {
+    double tick_size{0.01};
+    double lot_size{1.0};
+    // number of ticks each side of the book indexes directly before the
+    // level arrays have to grow
+    price_t ladder_span{4096};
+    // the most ticks the level array of one side may ever cover (24 bytes
+    // each). a limit order whose price would stretch it further is
+    // rejected, so one stray price cannot allocate its distance from the
+    // book. at least 2 * ladder_span + 1.
+    price_t price_band{1 << 20};
+
+    price_t to_ticks(double price) const {
+        return static_cast<price_t>(std::llround(price / tick_size));
+    }
+    double to_price(price_t ticks) const { return ticks * tick_size; }
+
+    quantity_t to_lots(double quantity) const {
+        return static_cast<quantity_t>(std::llround(quantity / lot_size));
+    }
+    double to_quantity(quantity_t lots) const { return lots * lot_size; }
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// latency histograms for the hot paths. the order book times add, cancel
+// and match, the thread pool times how long each task sat in a queue and
+// how long it ran. the hooks only exist when built with
+// -DQUANT_INSTRUMENTATION: otherwise latency_scope is an empty object and
+// the pool keeps no timestamps, so production builds pay nothing for them.
+#ifdef QUANT_INSTRUMENTATION
+constexpr bool latency_enabled = true;
+#else
+constexpr bool latency_enabled = false;
+#endif
+
+// timestamps in ticks. on x86 that is the time stamp counter, about 20
+// cycles to read and not serializing, which is fine for operations that
+// take a few hundred. elsewhere it is steady_clock in nanoseconds.
+struct latency_clock {
+    static std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+#endif
+    }
+
+    // measured once against steady_clock over a few milliseconds, assumes
+    // an invariant tsc (every x86 of the last decade has one)
+    static double ns_per_tick() {
+#if defined(__x86_64__) || defined(__i386__)
+        static const double ratio = [] {
+            using clock = std::chrono::steady_clock;
+            auto start = clock::now();
+            std::uint64_t first = __rdtsc();
+            while (clock::now() - start < std::chrono::milliseconds(10)) {
+            }
+            std::uint64_t last = __rdtsc();
+            double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            return ns / static_cast<double>(last - first);
+        }();
+        return ratio;
+#else
+        return 1.0;
+#endif
+    }
+};
+
+// log-linear histogram in the HDR style: values below 2^sub_bits have a
+// bucket each, above that every power of two is split into 2^sub_bits
+// buckets, so a reported value is within 1/32 (about 3%) of the true one
+// over the whole 64 bit range in 15 KB. one thread records, any thread may
+// read: the counters are relaxed atomics written with a plain load and
+// store, which costs the same as an ordinary increment.
+class latency_histogram {
+  public:
+    static constexpr unsigned sub_bits = 5;
+    static constexpr size_t sub_count = size_t{1} << sub_bits;
+    static constexpr size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    latency_histogram() = default;
+    latency_histogram(const latency_histogram &) = delete;
+    latency_histogram &operator=(const latency_histogram &) = delete;
+
+    void record(std::uint64_t value) {
+        bump(counts[bucket(value)], 1);
+        bump(total, 1);
+        if (value > largest.load(std::memory_order_relaxed)) {
+            largest.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // adds other's samples, other may still be recording
+    void merge(const latency_histogram &other) {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            if (std::uint64_t n = other.counts[i].load(std::memory_order_relaxed)) {
+                bump(counts[i], n);
+            }
+        }
+        bump(total, other.total.load(std::memory_order_relaxed));
+        largest.store(std::max(largest.load(std::memory_order_relaxed),
+                               other.largest.load(std::memory_order_relaxed)),
+                      std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for (auto &c : counts) {
+            c.store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        largest.store(0, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    std::uint64_t max() const { return largest.load(std::memory_order_relaxed); }
+
+    // the value at or below which a fraction q of the samples fall, as the
+    // top of its bucket (never above the largest sample), 0 when empty
+    std::uint64_t percentile(double q) const {
+        std::uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        std::uint64_t rank = static_cast<std::uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(n - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(bucket_top(i), max());
+            }
+        }
+        return max();
+    }
+
+  private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> counts{};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> largest{0};
+
+    static void bump(std::atomic<std::uint64_t> &c, std::uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static size_t bucket(std::uint64_t value) {
+        if (value < sub_count) {
+            return static_cast<size_t>(value);
+        }
+        unsigned shift = static_cast<unsigned>(std::bit_width(value)) - 1 - sub_bits;
+        return (shift + 1) * sub_count + static_cast<size_t>((value >> shift) & (sub_count - 1));
+    }
+
+    static std::uint64_t bucket_top(size_t i) {
+        if (i < sub_count) {
+            return i;
+        }
+        unsigned shift = static_cast<unsigned>(i / sub_count) - 1;
+        std::uint64_t low = static_cast<std::uint64_t>(sub_count + i % sub_count) << shift;
+        return low + ((std::uint64_t{1} << shift) - 1);
+    }
+};
+
+// what gets timed
+enum class latency_point : std::uint8_t {
+    book_add,    // order_book::add_order, matching included
+    book_cancel, // order_book::cancel_order
+    book_match,  // an incoming order trading against the book
+    task_wait,   // thread_pool task, submit to start
+    task_run     // thread_pool task, start to finish
+};
+constexpr size_t latency_point_count = 5;
+
+inline const char *latency_point_name(latency_point point) {
+    static constexpr const char *names[latency_point_count] = {
+        "book_add", "book_cancel", "book_match", "task_wait", "task_run"};
+    return names[static_cast<size_t>(point)];
+}
+
+// one set of histograms per thread that ever recorded, so recording never
+// shares a cache line. sets outlive their thread and are summed on demand.
+class latency_registry {
+  public:
+    static latency_registry &instance() {
+        static latency_registry registry;
+        return registry;
+    }
+
+    // the calling thread's histogram for point, created on first use
+    static latency_histogram &local(latency_point point) {
+        static thread_local latency_histogram *mine = instance().attach();
+        return mine[static_cast<size_t>(point)];
+    }
+
+    // every thread's samples for point added into out
+    void collect(latency_point point, latency_histogram &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &set : threads) {
+            out.merge(set[static_cast<size_t>(point)]);
+        }
+    }
+
+    // drops all samples, meant for quiet moments between runs (a thread
+    // recording at the same time may keep a sample or lose one)
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &set : threads) {
+            for (size_t p = 0; p < latency_point_count; ++p) {
+                set[p].reset();
+            }
+        }
+    }
+
+  private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<latency_histogram[]>> threads;
+
+    latency_histogram *attach() {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.push_back(std::make_unique<latency_histogram[]>(latency_point_count));
+        return threads.back().get();
+    }
+};
+
+// records a duration in ticks, a no-op without QUANT_INSTRUMENTATION
+inline void latency_record(latency_point point, std::uint64_t ticks) {
+    if constexpr (latency_enabled) {
+        latency_registry::local(point).record(ticks);
+    }
+}
+
+// times the enclosing scope
+class latency_scope {
+  public:
+#ifdef QUANT_INSTRUMENTATION
+    explicit latency_scope(latency_point point) : point(point), start(latency_clock::now()) {}
+    ~latency_scope() { latency_record(point, latency_clock::now() - start); }
+#else
+    explicit latency_scope(latency_point) {}
+#endif
+
+    latency_scope(const latency_scope &) = delete;
+    latency_scope &operator=(const latency_scope &) = delete;
+
+#ifdef QUANT_INSTRUMENTATION
+  private:
+    latency_point point;
+    std::uint64_t start;
+#endif
+};
+
+// percentiles of a histogram of ticks, in nanoseconds
+struct latency_summary {
+    std::uint64_t count;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+inline latency_summary summarize(const latency_histogram &h,
+                                 double ns_per_tick = latency_clock::ns_per_tick()) {
+    auto ns = [ns_per_tick](std::uint64_t ticks) { return static_cast<double>(ticks) * ns_per_tick; };
+    return latency_summary{h.count(), ns(h.percentile(0.50)), ns(h.percentile(0.99)),
+                           ns(h.percentile(0.999)), ns(h.max())};
+}
+
+inline std::ostream &operator<<(std::ostream &out, const latency_summary &s) {
+    return out << "count: " << s.count << " ns p50: " << s.p50 << " p99: " << s.p99
+               << " p99.9: " << s.p999 << " max: " << s.max;
+}
+
+// one line per timed point that has samples, summed over all threads
+inline void latency_report(std::ostream &out) {
+    for (size_t p = 0; p < latency_point_count; ++p) {
+        auto point = static_cast<latency_point>(p);
+        auto merged = std::make_unique<latency_histogram>();
+        latency_registry::instance().collect(point, *merged);
+        if (merged->count() > 0) {
+            out << latency_point_name(point) << ' ' << summarize(*merged) << '\n';
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read only mapping of a whole file, for the binary formats that are used in
+// place straight from the page cache. `what` names the kind of file in error
+// messages, a file shorter than min_length (its header) is refused.
+class mapped_file {
+  public:
+    mapped_file(const std::string &path, const char *what, size_t min_length) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fail("cannot open", what, path, errno);
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            const int error = errno;
+            ::close(fd);
+            fail("cannot stat", what, path, error);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length < min_length) {
+            ::close(fd);
+            throw std::runtime_error(std::string(what) + " file too short " + path);
+        }
+        data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        const int error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            fail("cannot map", what, path, error);
+        }
+        ::madvise(data, length, MADV_SEQUENTIAL);
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    ~mapped_file() { ::munmap(data, length); }
+
+    const char *bytes() const { return static_cast<const char *>(data); }
+    size_t size() const { return length; }
+
+  private:
+    void *data{nullptr};
+    size_t length{0};
+
+    [[noreturn]] static void fail(const char *action, const char *what,
+                                  const std::string &path, int error) {
+        throw std::runtime_error(std::string(action) + " " + what + " file " + path + ": " +
+                                 std::strerror(error));
+    }
+};
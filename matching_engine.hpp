@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "feed.hpp"
+#include "mpsc_ring.hpp"
+#include "order_book.hpp"
+#include "thread_pool.hpp"
+
+using symbol_id = std::uint32_t;
+
+// many instruments matched in parallel. every symbol belongs to exactly one
+// shard and every shard is drained by one long running task on its own pool
+// worker, so each book only ever has a single writer and needs no locks.
+// producers route messages into the shard's lock-free queue.
+class matching_engine {
+  public:
+    // with cores the shard workers are pinned, worker i to
+    // cores[i % cores.size()], so every shard keeps one core for as long as
+    // the engine runs. the shard loop does its own polling. throws
+    // std::invalid_argument for zero shards.
+    explicit matching_engine(size_t shard_count, size_t queue_capacity = 1 << 16,
+                             const std::vector<int> &cores = {})
+        : pool(checked_shards(shard_count),
+               thread_pool::options{thread_pool::scheduling::shared_queue,
+                                    thread_pool::idle_policy::block, 256, cores}) {
+        for (size_t i = 0; i < shard_count; ++i) {
+            shards.push_back(std::make_unique<shard>(queue_capacity));
+        }
+    }
+
+    matching_engine(const matching_engine &) = delete;
+    matching_engine &operator=(const matching_engine &) = delete;
+
+    ~matching_engine() { stop(); }
+
+    // symbols are added before start(), they are spread round robin over
+    // the shards
+    symbol_id add_symbol(const instrument &inst, size_t expected_orders = 1 << 16) {
+        if (running) {
+            throw std::logic_error("add_symbol after start");
+        }
+        books.push_back(std::make_unique<order_book>(inst, expected_orders));
+        return static_cast<symbol_id>(books.size() - 1);
+    }
+
+    // the book of a symbol, only to be touched while the engine is stopped
+    // (setting sinks, reading the final state). throws std::out_of_range for
+    // a symbol that was never added.
+    order_book &book(symbol_id symbol) { return *books[checked_symbol(symbol)]; }
+
+    size_t shard_count() const { return shards.size(); }
+    size_t shard_of(symbol_id symbol) const { return symbol % shards.size(); }
+
+    void start() {
+        if (running) {
+            return;
+        }
+        running = true;
+        for (auto &s : shards) {
+            s->stopping.store(false, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < shards.size(); ++i) {
+            pool.post([this, i]() { run_shard(*shards[i]); });
+        }
+    }
+
+    // any thread, false when the shard's queue is full. an unknown symbol
+    // throws std::out_of_range here, on the producer, rather than reaching
+    // the shard worker.
+    bool try_submit(symbol_id symbol, const message &m) {
+        shard &s = *shards[shard_of(checked_symbol(symbol))];
+        if (!s.queue.try_push(routed_message{m, symbol})) {
+            return false;
+        }
+        s.submitted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // any thread, waits for room in the shard's queue
+    void submit(symbol_id symbol, const message &m) {
+        while (!try_submit(symbol, m)) {
+            std::this_thread::yield();
+        }
+    }
+
+    // wait until every message submitted so far has been applied
+    void wait_until_idle() const {
+        for (const auto &s : shards) {
+            while (s->processed.load(std::memory_order_acquire) !=
+                   s->submitted.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // drains the queues and returns the workers to the pool
+    void stop() {
+        if (!running) {
+            return;
+        }
+        for (auto &s : shards) {
+            s->stopping.store(true, std::memory_order_release);
+        }
+        pool.wait_for_tasks();
+        running = false;
+    }
+
+  private:
+    struct routed_message {
+        message msg;
+        symbol_id symbol;
+    };
+
+    struct shard {
+        explicit shard(size_t capacity) : queue(capacity) {}
+        mpsc_ring<routed_message> queue;
+        alignas(64) std::atomic<size_t> submitted{0};
+        alignas(64) std::atomic<size_t> processed{0};
+        std::atomic<bool> stopping{false};
+    };
+
+    // every symbol maps to symbol % shard_count, checked before the pool
+    // starts any workers
+    static size_t checked_shards(size_t shard_count) {
+        if (shard_count == 0) {
+            throw std::invalid_argument("matching_engine needs at least one shard");
+        }
+        return shard_count;
+    }
+
+    // books only grows before start(), so producers can read its size
+    symbol_id checked_symbol(symbol_id symbol) const {
+        if (symbol >= books.size()) {
+            throw std::out_of_range("matching_engine has no symbol " +
+                                    std::to_string(symbol));
+        }
+        return symbol;
+    }
+
+    std::vector<std::unique_ptr<order_book>> books;
+    std::vector<std::unique_ptr<shard>> shards;
+    bool running{false};
+    thread_pool pool;
+
+    void run_shard(shard &s) {
+        routed_message r;
+        size_t idle_polls = 0;
+        while (true) {
+            size_t batch = 0;
+            while (batch < 256 && s.queue.try_pop(r)) {
+                apply(*books[r.symbol], r.msg);
+                ++batch;
+            }
+            if (batch) {
+                s.processed.fetch_add(batch, std::memory_order_release);
+                idle_polls = 0;
+                continue;
+            }
+            if (s.stopping.load(std::memory_order_acquire)) {
+                // producers are done once stop() is called, one last look
+                if (!s.queue.try_pop(r)) {
+                    return;
+                }
+                apply(*books[r.symbol], r.msg);
+                s.processed.fetch_add(1, std::memory_order_release);
+                continue;
+            }
+            // spin briefly for the next burst, then give the core away
+            if (++idle_polls > 64) {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
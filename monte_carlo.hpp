@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "rng.hpp"
+#include "thread_pool.hpp"
+
+// batched monte carlo π estimator. points are drawn uniformly in the unit
+// square and tested against the quarter circle x*x + y*y <= 1 in doubles,
+// so nothing is rounded to a grid. random numbers are produced a block at a
+// time into flat buffers and the test runs over the buffers with SIMD,
+// picking AVX-512 or AVX2 when the compiler targets them (-march=native)
+// and a plain loop the compiler can still vectorize otherwise.
+
+// number of i < n with x[i]^2 + y[i]^2 <= 1
+inline std::uint64_t count_in_circle(const double *x, const double *y, size_t n) {
+    size_t i = 0;
+    std::uint64_t hits = 0;
+#if defined(__AVX512F__)
+    const __m512d one = _mm512_set1_pd(1.0);
+    for (; i + 8 <= n; i += 8) {
+        __m512d vx = _mm512_loadu_pd(x + i);
+        __m512d vy = _mm512_loadu_pd(y + i);
+        __m512d d = _mm512_add_pd(_mm512_mul_pd(vx, vx), _mm512_mul_pd(vy, vy));
+        hits += static_cast<std::uint64_t>(
+            __builtin_popcount(_mm512_cmp_pd_mask(d, one, _CMP_LE_OQ)));
+    }
+#elif defined(__AVX2__)
+    // a passing compare is all ones, i.e. -1 as an integer, so subtracting
+    // the mask counts hits per lane without leaving the vector registers
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256i lane_hits = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4) {
+        __m256d vx = _mm256_loadu_pd(x + i);
+        __m256d vy = _mm256_loadu_pd(y + i);
+        __m256d d = _mm256_add_pd(_mm256_mul_pd(vx, vx), _mm256_mul_pd(vy, vy));
+        __m256d inside = _mm256_cmp_pd(d, one, _CMP_LE_OQ);
+        lane_hits = _mm256_sub_epi64(lane_hits, _mm256_castpd_si256(inside));
+    }
+    alignas(32) std::uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), lane_hits);
+    hits = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; ++i) {
+        hits += (x[i] * x[i] + y[i] * y[i]) <= 1.0;
+    }
+    return hits;
+}
+
+// draws n points and returns how many fell inside the quarter circle
+template <size_t lanes>
+std::uint64_t sample_quarter_circle(xoshiro_lanes<lanes> &rng, std::uint64_t n) {
+    constexpr size_t block = 1024;
+    static_assert(block % lanes == 0);
+    alignas(64) double x[block];
+    alignas(64) double y[block];
+    std::uint64_t hits = 0;
+    while (n > 0) {
+        size_t count = n < block ? static_cast<size_t>(n) : block;
+        // the generator works in whole lane groups, a short tail ignores
+        // the few extra numbers
+        size_t drawn = (count + lanes - 1) / lanes * lanes;
+        rng.fill(x, drawn);
+        rng.fill(y, drawn);
+        hits += count_in_circle(x, y, count);
+        n -= count;
+    }
+    return hits;
+}
+
+// the same count for samples [first, first + n) of a block stream. every
+// point depends only on the stream and the sample index, so splitting a run
+// into any chunks on any number of threads sums to the same hit count.
+inline std::uint64_t sample_quarter_circle(const block_stream &stream,
+                                           std::uint64_t first, std::uint64_t n) {
+    constexpr size_t block = block_stream::block_size;
+    alignas(64) double x[block];
+    alignas(64) double y[block];
+    std::uint64_t hits = 0;
+    while (n > 0) {
+        // one stream block at a time, so whole blocks skip the copy
+        size_t count = std::min<std::uint64_t>(n, block - first % block);
+        stream.fill(first, count, x, y);
+        hits += count_in_circle(x, y, count);
+        first += count;
+        n -= count;
+    }
+    return hits;
+}
+
+// running mean and variance of a stream of samples (Welford), mergeable so
+// every worker keeps its own and they are combined without a lock (Chan et
+// al. pairwise update)
+struct running_stats {
+    std::uint64_t count{0};
+    double mean{0.0};
+    // sum of squared deviations from the mean
+    double m2{0.0};
+
+    void add(double x) {
+        ++count;
+        double delta = x - mean;
+        mean += delta / static_cast<double>(count);
+        m2 += delta * (x - mean);
+    }
+
+    // a batch given by its count, sum and sum of squares. fine for the
+    // batch sizes a kernel works in, the merge keeps the totals stable.
+    void add_batch(std::uint64_t n, double sum, double sum_sq) {
+        if (n == 0) {
+            return;
+        }
+        running_stats batch;
+        batch.count = n;
+        batch.mean = sum / static_cast<double>(n);
+        batch.m2 = std::max(0.0, sum_sq - sum * batch.mean);
+        merge(batch);
+    }
+
+    // n samples at once: mean and squared deviations of the block in two
+    // plain passes (they vectorize), then one merge
+    void add_block(const double *x, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        double sum = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += x[i];
+        }
+        running_stats block;
+        block.count = n;
+        block.mean = sum / static_cast<double>(n);
+        for (size_t i = 0; i < n; ++i) {
+            double d = x[i] - block.mean;
+            block.m2 += d * d;
+        }
+        merge(block);
+    }
+
+    void merge(const running_stats &other) {
+        if (other.count == 0) {
+            return;
+        }
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        std::uint64_t total = count + other.count;
+        double delta = other.mean - mean;
+        double weight = static_cast<double>(other.count) / static_cast<double>(total);
+        mean += delta * weight;
+        m2 += other.m2 + delta * delta * static_cast<double>(count) * weight;
+        count = total;
+    }
+
+    double variance() const {
+        return count > 1 ? m2 / static_cast<double>(count - 1) : 0.0;
+    }
+    double std_error() const {
+        return count > 1 ? std::sqrt(variance() / static_cast<double>(count)) : 0.0;
+    }
+    // half width of the confidence interval mean +- z * std_error, 1.96 is
+    // the two sided 95% normal quantile
+    double half_width(double z = 1.96) const { return z * std_error(); }
+};
+
+struct convergence_options {
+    // stop once the confidence half width is at or below this
+    double tolerance{1e-4};
+    double z{1.96};
+    // stop once this much wall time has been spent, zero for no limit
+    std::chrono::nanoseconds time_budget{0};
+    // samples per chunk handed to a worker, and per round between two
+    // convergence checks. chunks and rounds do not depend on the thread
+    // count and chunks are merged in order, so a run that stops on
+    // tolerance stops at the same sample on any pool.
+    std::uint64_t batch_size{1 << 16};
+    std::uint64_t round_size{1 << 22};
+    // the least samples before the error estimate is trusted
+    std::uint64_t min_samples{1 << 20};
+    // hard cap on samples
+    std::uint64_t max_samples{std::uint64_t{1} << 40};
+};
+
+enum class stop_reason : std::uint8_t { tolerance, time_budget, max_samples };
+
+inline const char *describe(stop_reason reason) {
+    switch (reason) {
+    case stop_reason::tolerance:
+        return "tolerance reached";
+    case stop_reason::time_budget:
+        return "time budget spent";
+    case stop_reason::max_samples:
+        return "sample cap reached";
+    }
+    return "unknown";
+}
+
+struct convergence_result {
+    running_stats stats;
+    double half_width;
+    stop_reason reason;
+    std::chrono::nanoseconds elapsed;
+};
+
+// runs sample_batch(first, n, stats) over consecutive sample ranges on the
+// pool, a round of options.round_size samples at a time, until the estimate
+// is within tolerance or the time budget or sample cap is hit. each call
+// must add exactly n observations to stats, a round that comes back with a
+// different count throws std::logic_error. every chunk
+// of options.batch_size samples folds into its own running_stats and the
+// chunks are merged in sample order on the calling thread.
+// progress(stats, half_width), if given, sees the estimate after every
+// round. with a block_stream the samples only depend on their index, so a
+// given number of samples gives the same bits whatever the pool size.
+// the stopping rule is checked between rounds, so the time budget can be
+// overshot by up to one round. a zero round size or sample cap, or a
+// min_samples above max_samples, throws std::invalid_argument.
+template <class F, class P>
+convergence_result run_until_converged(thread_pool &pool, F &&sample_batch,
+                                       const convergence_options &options,
+                                       P &&progress) {
+    if (options.round_size == 0 || options.max_samples == 0 ||
+        options.min_samples > options.max_samples) {
+        throw std::invalid_argument("run_until_converged needs round_size > 0 and "
+                                    "0 < max_samples >= min_samples");
+    }
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    running_stats total;
+    while (true) {
+        std::uint64_t first = total.count;
+        std::uint64_t n = std::min(options.round_size, options.max_samples - first);
+        running_stats round = pool.parallel_reduce_ordered(
+            static_cast<size_t>(first), static_cast<size_t>(first + n), running_stats{},
+            [&sample_batch](size_t begin, size_t end, running_stats &acc) {
+                sample_batch(begin, end - begin, acc);
+            },
+            [](running_stats a, const running_stats &b) {
+                a.merge(b);
+                return a;
+            },
+            static_cast<size_t>(options.batch_size));
+        if (round.count != n) {
+            throw std::logic_error("sample_batch added a different number of samples "
+                                   "than it was asked for");
+        }
+        total.merge(round);
+
+        double half_width = total.half_width(options.z);
+        progress(total, half_width);
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+        if (total.count >= options.min_samples && half_width <= options.tolerance) {
+            return {total, half_width, stop_reason::tolerance, elapsed};
+        }
+        if (options.time_budget.count() > 0 && elapsed >= options.time_budget) {
+            return {total, half_width, stop_reason::time_budget, elapsed};
+        }
+        if (total.count >= options.max_samples) {
+            return {total, half_width, stop_reason::max_samples, elapsed};
+        }
+    }
+}
+
+template <class F>
+convergence_result run_until_converged(thread_pool &pool, F &&sample_batch,
+                                       const convergence_options &options) {
+    return run_until_converged(pool, sample_batch, options,
+                               [](const running_stats &, double) {});
+}
+
+// π samples: 4 for a point inside the quarter circle and 0 outside, so the
+// running mean is the estimate
+inline void sample_pi(const block_stream &stream, std::uint64_t first, std::uint64_t n,
+                      running_stats &stats) {
+    double hits = static_cast<double>(sample_quarter_circle(stream, first, n));
+    stats.add_batch(n, 4.0 * hits, 16.0 * hits);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// bounded lock-free multi producer / single consumer ring. every cell
+// carries a sequence number telling producers and the consumer whose turn it
+// is, so producers only contend on the tail counter and never on a lock
+// (Vyukov's bounded queue, with the consumer side simplified for a single
+// reader).
+template <class T> class mpsc_ring {
+  public:
+    // capacity is rounded up to a power of two
+    explicit mpsc_ring(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        cells = std::make_unique<cell[]>(size);
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+    }
+
+    mpsc_ring(const mpsc_ring &) = delete;
+    mpsc_ring &operator=(const mpsc_ring &) = delete;
+
+    // any thread, false when the ring is full
+    bool try_push(const T &value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            cell &c = cells[pos & mask];
+            size_t seq = c.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                    c.value = value;
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // consumer thread only, false when the ring is empty
+    bool try_pop(T &value) {
+        cell &c = cells[head & mask];
+        if (c.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        value = c.value;
+        c.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+  private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> cells;
+    size_t mask{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head{0};
+};
@@ -0,0 +1,117 @@
+// monte carlo option pricing demo: prices and greeks of european, asian and
+// barrier options under GBM, next to the closed form where there is one, and
+// the european price under every sampling mode
+// build: cmake --build build/native --target option_pricing
+// usage: option_pricing [paths] [seed] [threads]
+#include "option_pricing.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+static void print(const char *name, const running_stats &s) {
+    std::cout << "  " << std::setw(6) << name << " = " << std::setw(10) << s.mean
+              << " +- " << s.half_width() << "\n";
+}
+
+int main(int argc, char **argv) {
+    std::uint64_t paths = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 20;
+    std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 42;
+    size_t threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10)
+                              : std::max(1u, std::thread::hardware_concurrency());
+    thread_pool pool(threads);
+    point_set pseudo(sampling_mode::pseudo, seed);
+
+    gbm_model model;
+    model.spot = 100.0;
+    model.rate = 0.03;
+    model.dividend = 0.01;
+    model.volatility = 0.2;
+    time_grid grid{1.0, 52};
+    const double strike = 100.0;
+    std::cout << std::fixed << std::setprecision(4);
+
+    auto timed = [](const char *title, auto &&run) {
+        auto start = std::chrono::steady_clock::now();
+        auto result = run();
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << title << " (" << ms << " ms)\n";
+        return result;
+    };
+
+    european_payoff call{option_kind::call, strike};
+    std::cout << "european call, black-scholes = " << black_scholes(model, grid.maturity, option_kind::call, strike) << "\n";
+    greeks pw = timed("pathwise", [&]() { return pathwise_greeks(pool, model, grid, call, paths, pseudo); });
+    print("price", pw.price);
+    print("delta", pw.delta);
+    print("vega", pw.vega);
+    greeks bump = timed("bump and revalue", [&]() { return bump_greeks(pool, model, grid, call, paths, pseudo); });
+    print("price", bump.price);
+    print("delta", bump.delta);
+    print("gamma", bump.gamma);
+    print("vega", bump.vega);
+
+    asian_payoff asian{option_kind::call, strike};
+    greeks asian_greeks = timed("\nasian call, pathwise", [&]() { return pathwise_greeks(pool, model, grid, asian, paths, pseudo); });
+    print("price", asian_greeks.price);
+    print("delta", asian_greeks.delta);
+    print("vega", asian_greeks.vega);
+
+    barrier_payoff out{option_kind::call, strike, barrier_kind::up_and_out, 130.0};
+    barrier_payoff in{option_kind::call, strike, barrier_kind::up_and_in, 130.0};
+    greeks out_greeks = timed("\nup and out call at 130, bump and revalue", [&]() { return bump_greeks(pool, model, grid, out, paths, pseudo); });
+    print("price", out_greeks.price);
+    print("delta", out_greeks.delta);
+    print("gamma", out_greeks.gamma);
+    print("vega", out_greeks.vega);
+    // on the same paths knock in plus knock out is exactly the vanilla
+    running_stats in_price = price(pool, model, grid, in, paths, pseudo);
+    std::cout << "  in + out = " << in_price.mean + out_greeks.price.mean
+              << ", vanilla on the same paths = " << bump.price.mean << "\n";
+
+    // no fixed path count: price the asian until the 95% interval is a cent wide
+    convergence_options options;
+    options.tolerance = 0.005;
+    options.batch_size = 4 * path_block;
+    options.round_size = 64 * path_block;
+    options.min_samples = options.round_size;
+    options.time_budget = std::chrono::seconds(5);
+    convergence_result converged = run_until_converged(
+        pool,
+        [&](std::uint64_t first, std::uint64_t n, running_stats &stats) {
+            price_paths(model, grid, asian, pseudo, first, n, stats);
+        },
+        options);
+    // only a run that stopped on tolerance is within it, a budget or cap
+    // limited one reports the interval it got to
+    std::cout << "\nasian call, target +- " << options.tolerance << ": " << converged.stats.mean
+              << " +- " << converged.half_width << " after " << converged.stats.count
+              << " paths, " << std::chrono::duration<double, std::milli>(converged.elapsed).count()
+              << " ms, " << describe(converged.reason)
+              << (converged.reason == stop_reason::tolerance ? "" : ", tolerance not met")
+              << "\n";
+
+    // the same number of paths under every sampling mode, the error against
+    // black-scholes next to the reported 95% half width
+    double exact = black_scholes(model, grid.maturity, option_kind::call, strike);
+    std::cout << "\neuropean call by sampling mode, " << paths << " paths\n";
+    const std::pair<const char *, sampling_mode> modes[] = {
+        {"pseudo", sampling_mode::pseudo},         {"antithetic", sampling_mode::antithetic},
+        {"stratified", sampling_mode::stratified}, {"sobol", sampling_mode::sobol},
+        {"halton", sampling_mode::halton},
+    };
+    auto by_mode = [&](const char *name, const point_set &points, const control_variate &control) {
+        auto start = std::chrono::steady_clock::now();
+        running_stats s = price(pool, model, grid, call, paths, points, control);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << std::setw(18) << std::left << name << std::right << std::setw(10) << s.mean
+                  << " +- " << std::setw(8) << s.half_width() << "  error " << std::setw(8)
+                  << std::abs(s.mean - exact) << "  " << std::setw(9) << ms << " ms\n";
+    };
+    for (const auto &[name, mode] : modes) {
+        by_mode(name, point_set(mode, seed), control_variate{});
+    }
+    by_mode("pseudo + control", pseudo, spot_control(model, grid, call, seed));
+    return 0;
+}
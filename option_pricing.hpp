@@ -0,0 +1,510 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "fast_math.hpp"
+#include "monte_carlo.hpp"
+#include "rng.hpp"
+#include "sampling.hpp"
+#include "thread_pool.hpp"
+
+// monte carlo pricing under geometric brownian motion.
+//
+// paths are simulated path_block at a time in structure of arrays form: one
+// array of spots for the block, stepped forward in time, with the payoff
+// folding in what it needs (a running sum, a knock flag) after every step.
+// a block's working set stays in L1/L2 and no path is ever stored in full.
+// blocks run on the thread pool through parallel_reduce_ordered.
+//
+// path p is point p of a point_set (sampling.hpp), one dimension per time
+// step turned into a normal by the inverse cdf, so a path only depends on
+// the point set and its index: any number of threads simulates the very
+// same paths, and since the chunks are merged in path order the price and
+// greeks come out bit for bit the same on any pool. pricing a bumped model
+// on the same point set reuses exactly the same paths (common random
+// numbers). paths are averaged per group of the point set and
+// every estimate is over group means, with pseudo random points that is
+// simply one path per observation.
+
+enum class option_kind : std::uint8_t { call, put };
+
+struct gbm_model {
+    double spot{100.0};
+    double rate{0.0};
+    double dividend{0.0};
+    double volatility{0.2};
+};
+
+// uniform steps, payoffs observe the spot at the end of every step
+struct time_grid {
+    double maturity{1.0};
+    size_t steps{1};
+};
+
+constexpr size_t path_block = block_stream::block_size;
+
+// spot of every path in the block after a step, plus the pathwise
+// derivatives when the engine tracks them (null otherwise):
+// d_spot = dS_t/dS_0 and d_vol = dS_t/dsigma
+struct path_step {
+    const double *spot;
+    const double *d_spot;
+    const double *d_vol;
+    size_t n;
+};
+
+// f(i) for every path of a block. a full block gets its own copy of the loop
+// with a constant trip count, which gcc vectorizes even at -O2.
+template <class F> inline void for_each_path(size_t n, F &&f) {
+    if (n == path_block) {
+        for (size_t i = 0; i < path_block; ++i) {
+            f(i);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            f(i);
+        }
+    }
+}
+
+// a payoff provides
+//   struct state                      per block scratch, arrays of path_block
+//   start(state &, n)                 before the first step
+//   observe(state &, const path_step &) after every step
+//   finish(state &, const path_step &, value, delta, vega)
+//                                     undiscounted payoff per path, and its
+//                                     pathwise delta and vega when those
+//                                     pointers are not null
+//   static constexpr bool pathwise    whether finish can fill delta and vega
+
+inline double intrinsic(option_kind kind, double underlying, double strike) {
+    return std::max(kind == option_kind::call ? underlying - strike : strike - underlying, 0.0);
+}
+
+// d intrinsic / d underlying, the indicator of being in the money
+inline double intrinsic_slope(option_kind kind, double underlying, double strike) {
+    if (kind == option_kind::call) {
+        return underlying > strike ? 1.0 : 0.0;
+    }
+    return underlying < strike ? -1.0 : 0.0;
+}
+
+struct european_payoff {
+    option_kind kind;
+    double strike;
+
+    static constexpr bool pathwise = true;
+    struct state {};
+
+    void start(state &, size_t) const {}
+    void observe(state &, const path_step &) const {}
+
+    void finish(state &, const path_step &p, double *value, double *delta,
+                double *vega) const {
+        for (size_t i = 0; i < p.n; ++i) {
+            value[i] = intrinsic(kind, p.spot[i], strike);
+        }
+        if (delta) {
+            for (size_t i = 0; i < p.n; ++i) {
+                double slope = intrinsic_slope(kind, p.spot[i], strike);
+                delta[i] = slope * p.d_spot[i];
+                vega[i] = slope * p.d_vol[i];
+            }
+        }
+    }
+};
+
+// arithmetic average of the spot over the step dates
+struct asian_payoff {
+    option_kind kind;
+    double strike;
+
+    static constexpr bool pathwise = true;
+    struct state {
+        size_t observations;
+        std::array<double, path_block> sum;
+        std::array<double, path_block> d_spot_sum;
+        std::array<double, path_block> d_vol_sum;
+    };
+
+    void start(state &s, size_t n) const {
+        s.observations = 0;
+        std::fill_n(s.sum.begin(), n, 0.0);
+        std::fill_n(s.d_spot_sum.begin(), n, 0.0);
+        std::fill_n(s.d_vol_sum.begin(), n, 0.0);
+    }
+
+    void observe(state &s, const path_step &p) const {
+        ++s.observations;
+        for_each_path(p.n, [&](size_t i) { s.sum[i] += p.spot[i]; });
+        if (p.d_vol) {
+            for_each_path(p.n, [&](size_t i) {
+                s.d_spot_sum[i] += p.d_spot[i];
+                s.d_vol_sum[i] += p.d_vol[i];
+            });
+        }
+    }
+
+    void finish(state &s, const path_step &p, double *value, double *delta,
+                double *vega) const {
+        double scale = 1.0 / static_cast<double>(s.observations);
+        for (size_t i = 0; i < p.n; ++i) {
+            value[i] = intrinsic(kind, s.sum[i] * scale, strike);
+        }
+        if (delta) {
+            for (size_t i = 0; i < p.n; ++i) {
+                double slope = intrinsic_slope(kind, s.sum[i] * scale, strike);
+                delta[i] = slope * s.d_spot_sum[i] * scale;
+                vega[i] = slope * s.d_vol_sum[i] * scale;
+            }
+        }
+    }
+};
+
+enum class barrier_kind : std::uint8_t { up_and_out, down_and_out, up_and_in, down_and_in };
+
+// vanilla payoff that is knocked out (or only knocked in) once the spot
+// touches the barrier on a step date. the payoff jumps at the barrier, so
+// there is no pathwise derivative, use bump_greeks.
+struct barrier_payoff {
+    option_kind kind;
+    double strike;
+    barrier_kind type;
+    double barrier;
+
+    static constexpr bool pathwise = false;
+    struct state {
+        std::array<double, path_block> touched;
+    };
+
+    void start(state &s, size_t n) const { std::fill_n(s.touched.begin(), n, 0.0); }
+
+    void observe(state &s, const path_step &p) const {
+        bool up = type == barrier_kind::up_and_out || type == barrier_kind::up_and_in;
+        for_each_path(p.n, [&](size_t i) {
+            bool hit = up ? p.spot[i] >= barrier : p.spot[i] <= barrier;
+            s.touched[i] = hit ? 1.0 : s.touched[i];
+        });
+    }
+
+    void finish(state &s, const path_step &p, double *value, double *, double *) const {
+        bool knock_out = type == barrier_kind::up_and_out || type == barrier_kind::down_and_out;
+        for (size_t i = 0; i < p.n; ++i) {
+            double alive = knock_out ? 1.0 - s.touched[i] : s.touched[i];
+            value[i] = alive * intrinsic(kind, p.spot[i], strike);
+        }
+    }
+};
+
+// closed form price of a european option, the reference the engine is
+// checked against
+inline double black_scholes(const gbm_model &m, double maturity, option_kind kind,
+                            double strike) {
+    double sd = m.volatility * std::sqrt(maturity);
+    double d1 = (std::log(m.spot / strike) +
+                 (m.rate - m.dividend + 0.5 * m.volatility * m.volatility) * maturity) /
+                sd;
+    double d2 = d1 - sd;
+    auto n = [](double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); };
+    double forward = m.spot * std::exp(-m.dividend * maturity);
+    double discounted = strike * std::exp(-m.rate * maturity);
+    if (kind == option_kind::call) {
+        return forward * n(d1) - discounted * n(d2);
+    }
+    return discounted * n(-d2) - forward * n(-d1);
+}
+
+struct greeks {
+    running_stats price;
+    running_stats delta;
+    running_stats gamma;
+    running_stats vega;
+
+    void merge(const greeks &other) {
+        price.merge(other.price);
+        delta.merge(other.delta);
+        gamma.merge(other.gamma);
+        vega.merge(other.vega);
+    }
+};
+
+// standard normals for one block and two consecutive steps
+struct normal_pair {
+    std::array<double, path_block> even;
+    std::array<double, path_block> odd;
+
+    void draw(const point_set &points, size_t step_pair, std::uint64_t first, size_t n) {
+        // the uniforms land in the output arrays and are transformed in
+        // place. the inverse cdf rather than Box-Muller: it maps 1 - u to -z
+        // and keeps every dimension its own, which is what antithetic,
+        // stratified and quasi random points rely on.
+        points.fill(step_pair, first, n, even.data(), odd.data());
+        inverse_normal(even.data(), n);
+        inverse_normal(odd.data(), n);
+    }
+};
+
+// simulates paths [first, first + n) (n <= path_block) of every model in
+// `models` on the same normals and writes the discounted payoffs to
+// value[k]. with track_pathwise the first model also gets pathwise delta
+// and vega. control, if not null, gets the discounted final spot of the
+// first model.
+template <bool track_pathwise, size_t scenarios, class payoff_t>
+void simulate_path_block(const std::array<gbm_model, scenarios> &models, const time_grid &grid,
+                    const payoff_t &payoff, const point_set &points, std::uint64_t first,
+                    size_t n, std::array<std::array<double, path_block>, scenarios> &value,
+                    double *delta, double *vega, double *control) {
+    normal_pair z;
+    std::array<std::array<double, path_block>, scenarios> spot;
+    std::array<typename payoff_t::state, scenarios> states;
+    // brownian motion so far, for dS/dsigma = S (W - sigma t)
+    std::array<double, path_block> w;
+    std::array<double, path_block> d_spot;
+    std::array<double, path_block> d_vol;
+
+    double dt = grid.maturity / static_cast<double>(grid.steps);
+    double sqrt_dt = std::sqrt(dt);
+    std::array<double, scenarios> drift;
+    std::array<double, scenarios> diffusion;
+    for (size_t k = 0; k < scenarios; ++k) {
+        const gbm_model &m = models[k];
+        drift[k] = (m.rate - m.dividend - 0.5 * m.volatility * m.volatility) * dt;
+        diffusion[k] = m.volatility * sqrt_dt;
+        std::fill_n(spot[k].begin(), n, m.spot);
+        payoff.start(states[k], n);
+    }
+    std::fill_n(w.begin(), n, 0.0);
+
+    for (size_t step = 0; step < grid.steps; ++step) {
+        if (step % 2 == 0) {
+            z.draw(points, step / 2, first, n);
+        }
+        const double *normals = step % 2 == 0 ? z.even.data() : z.odd.data();
+        for (size_t k = 0; k < scenarios; ++k) {
+            double *s = spot[k].data();
+            double mu = drift[k];
+            double sigma = diffusion[k];
+            for_each_path(n, [=](size_t i) { s[i] *= fast_exp(mu + sigma * normals[i]); });
+        }
+        path_step base{spot[0].data(), nullptr, nullptr, n};
+        if constexpr (track_pathwise) {
+            double inv_spot = 1.0 / models[0].spot;
+            double vol_t = models[0].volatility * dt * static_cast<double>(step + 1);
+            for_each_path(n, [&](size_t i) {
+                w[i] += sqrt_dt * normals[i];
+                d_spot[i] = spot[0][i] * inv_spot;
+                d_vol[i] = spot[0][i] * (w[i] - vol_t);
+            });
+            base.d_spot = d_spot.data();
+            base.d_vol = d_vol.data();
+        }
+        payoff.observe(states[0], base);
+        for (size_t k = 1; k < scenarios; ++k) {
+            payoff.observe(states[k], path_step{spot[k].data(), nullptr, nullptr, n});
+        }
+    }
+
+    double discount = std::exp(-models[0].rate * grid.maturity);
+    path_step base{spot[0].data(), d_spot.data(), d_vol.data(), n};
+    payoff.finish(states[0], base, value[0].data(), track_pathwise ? delta : nullptr,
+                  track_pathwise ? vega : nullptr);
+    for (size_t i = 0; i < n; ++i) {
+        value[0][i] *= discount;
+    }
+    if (control) {
+        for (size_t i = 0; i < n; ++i) {
+            control[i] = discount * spot[0][i];
+        }
+    }
+    if constexpr (track_pathwise) {
+        for (size_t i = 0; i < n; ++i) {
+            delta[i] *= discount;
+            vega[i] *= discount;
+        }
+    }
+    for (size_t k = 1; k < scenarios; ++k) {
+        double scenario_discount = std::exp(-models[k].rate * grid.maturity);
+        payoff.finish(states[k], path_step{spot[k].data(), nullptr, nullptr, n},
+                      value[k].data(), nullptr, nullptr);
+        for (size_t i = 0; i < n; ++i) {
+            value[k][i] *= scenario_discount;
+        }
+    }
+}
+
+// observations handed to the pool at a time, about four path blocks
+inline size_t pricing_grain(const point_set &points) {
+    return std::max<size_t>(1, 4 * path_block / points.group_size());
+}
+
+// the number of observations covering at least `paths` paths
+inline std::uint64_t observations(const point_set &points, std::uint64_t paths) {
+    return (paths + points.group_size() - 1) / points.group_size();
+}
+
+inline void check_dimensions(const point_set &points, const time_grid &grid) {
+    // the normals are drawn two steps at a time
+    if ((grid.steps + 1) / 2 * 2 > points.dimensions()) {
+        throw std::invalid_argument("time grid has more steps than the point set has dimensions");
+    }
+}
+
+// f(first, count) over the paths of observations [begin, end), in pieces
+// that stay on the stream's block boundaries so every block is drawn once
+template <class F>
+void for_each_path_chunk(const point_set &points, std::uint64_t begin, std::uint64_t end, F &&f) {
+    std::uint64_t first = begin * points.group_size();
+    std::uint64_t last = end * points.group_size();
+    while (first < last) {
+        size_t count = static_cast<size_t>(std::min<std::uint64_t>(last - first, path_block - first % path_block));
+        f(first, count);
+        first += count;
+    }
+}
+
+// the control variate for price_paths: the discounted final spot, whose
+// mean is spot e^(-dividend maturity) under the model, with beta fitted on
+// `pilot` pseudo random paths independent of any point set of this seed
+template <class payoff_t>
+control_variate spot_control(const gbm_model &model, const time_grid &grid,
+                             const payoff_t &payoff, std::uint64_t seed,
+                             size_t pilot = 4 * path_block) {
+    point_set pilot_points(sampling_mode::pseudo, seed ^ pilot_stream);
+    std::vector<double> f(pilot), c(pilot);
+    std::array<std::array<double, path_block>, 1> value;
+    for_each_path_chunk(pilot_points, 0, pilot, [&](std::uint64_t first, size_t count) {
+        simulate_path_block<false, 1>({model}, grid, payoff, pilot_points, first, count, value,
+                                      nullptr, nullptr, c.data() + first);
+        std::copy_n(value[0].begin(), count, f.begin() + first);
+    });
+    return control_variate{model.spot * std::exp(-model.dividend * grid.maturity),
+                           control_beta(f.data(), c.data(), pilot)};
+}
+
+// observations [first, first + n) of the discounted payoff, each the mean
+// over one group of paths, for run_until_converged or any other driver that
+// hands out ranges. with a control the payoffs are corrected by the
+// discounted final spot.
+template <class payoff_t>
+void price_paths(const gbm_model &model, const time_grid &grid, const payoff_t &payoff,
+                 const point_set &points, std::uint64_t first, std::uint64_t n,
+                 running_stats &stats, const control_variate &control = {}) {
+    std::array<std::array<double, path_block>, 1> value;
+    std::array<double, path_block> spot;
+    group_means groups(points.group_size());
+    for_each_path_chunk(points, first, first + n, [&](std::uint64_t begin, size_t count) {
+        simulate_path_block<false, 1>({model}, grid, payoff, points, begin, count, value,
+                                      nullptr, nullptr, spot.data());
+        for (size_t i = 0; i < count; ++i) {
+            value[0][i] = control.apply(value[0][i], spot[i]);
+        }
+        groups.add(value[0].data(), count, stats);
+    });
+}
+
+// price over at least `paths` paths (whole groups), the mean is the price
+// and std_error() its monte carlo error
+template <class payoff_t>
+running_stats price(thread_pool &pool, const gbm_model &model, const time_grid &grid,
+                    const payoff_t &payoff, std::uint64_t paths, const point_set &points,
+                    const control_variate &control = {}) {
+    check_dimensions(points, grid);
+    return pool.parallel_reduce_ordered(
+        size_t{0}, static_cast<size_t>(observations(points, paths)), running_stats{},
+        [&](size_t begin, size_t end, running_stats &acc) {
+            price_paths(model, grid, payoff, points, begin, end - begin, acc, control);
+        },
+        [](running_stats a, const running_stats &b) {
+            a.merge(b);
+            return a;
+        },
+        pricing_grain(points));
+}
+
+// price, delta, gamma and vega by central differences, revaluing the spot
+// and volatility bumped models on the very same paths in the same pass.
+// with common random numbers the noise of the two legs largely cancels, and
+// each greek comes with its own standard error. spot_bump is relative to
+// the spot, vol_bump absolute. both legs of each difference need a valid
+// model, so spot_bump must lie in (0, 1) and vol_bump in (0, volatility),
+// anything else throws std::invalid_argument (a low vol model needs a
+// smaller vol_bump than the default).
+template <class payoff_t>
+greeks bump_greeks(thread_pool &pool, const gbm_model &model, const time_grid &grid,
+                   const payoff_t &payoff, std::uint64_t paths, const point_set &points,
+                   double spot_bump = 0.01, double vol_bump = 0.01) {
+    check_dimensions(points, grid);
+    if (!(spot_bump > 0.0 && spot_bump < 1.0) ||
+        !(vol_bump > 0.0 && vol_bump < model.volatility)) {
+        throw std::invalid_argument("bump_greeks needs 0 < spot_bump < 1 and "
+                                    "0 < vol_bump < volatility");
+    }
+    double h = model.spot * spot_bump;
+    std::array<gbm_model, 5> models{model, model, model, model, model};
+    models[1].spot += h;
+    models[2].spot -= h;
+    models[3].volatility += vol_bump;
+    models[4].volatility -= vol_bump;
+    return pool.parallel_reduce_ordered(
+        size_t{0}, static_cast<size_t>(observations(points, paths)), greeks{},
+        [&](size_t begin, size_t end, greeks &acc) {
+            std::array<std::array<double, path_block>, 5> value;
+            std::array<double, path_block> delta, gamma, vega;
+            group_means price_groups(points.group_size()), delta_groups(points.group_size()),
+                gamma_groups(points.group_size()), vega_groups(points.group_size());
+            for_each_path_chunk(points, begin, end, [&](std::uint64_t first, size_t count) {
+                simulate_path_block<false, 5>(models, grid, payoff, points, first, count, value,
+                                              nullptr, nullptr, nullptr);
+                for (size_t i = 0; i < count; ++i) {
+                    delta[i] = (value[1][i] - value[2][i]) / (2.0 * h);
+                    gamma[i] = (value[1][i] - 2.0 * value[0][i] + value[2][i]) / (h * h);
+                    vega[i] = (value[3][i] - value[4][i]) / (2.0 * vol_bump);
+                }
+                price_groups.add(value[0].data(), count, acc.price);
+                delta_groups.add(delta.data(), count, acc.delta);
+                gamma_groups.add(gamma.data(), count, acc.gamma);
+                vega_groups.add(vega.data(), count, acc.vega);
+            });
+        },
+        [](greeks a, const greeks &b) {
+            a.merge(b);
+            return a;
+        },
+        pricing_grain(points));
+}
+
+// price, delta and vega from the pathwise derivative of the payoff: one
+// simulation, no bump size to tune, lower variance than differences. only
+// for payoffs that are continuous in the path (gamma is left empty).
+template <class payoff_t>
+greeks pathwise_greeks(thread_pool &pool, const gbm_model &model, const time_grid &grid,
+                       const payoff_t &payoff, std::uint64_t paths, const point_set &points) {
+    static_assert(payoff_t::pathwise, "payoff has no pathwise derivative, use bump_greeks");
+    check_dimensions(points, grid);
+    return pool.parallel_reduce_ordered(
+        size_t{0}, static_cast<size_t>(observations(points, paths)), greeks{},
+        [&](size_t begin, size_t end, greeks &acc) {
+            std::array<std::array<double, path_block>, 1> value;
+            std::array<double, path_block> delta, vega;
+            group_means price_groups(points.group_size()), delta_groups(points.group_size()),
+                vega_groups(points.group_size());
+            for_each_path_chunk(points, begin, end, [&](std::uint64_t first, size_t count) {
+                simulate_path_block<true, 1>({model}, grid, payoff, points, first, count, value,
+                                             delta.data(), vega.data(), nullptr);
+                price_groups.add(value[0].data(), count, acc.price);
+                delta_groups.add(delta.data(), count, acc.delta);
+                vega_groups.add(vega.data(), count, acc.vega);
+            });
+        },
+        [](greeks a, const greeks &b) {
+            a.merge(b);
+            return a;
+        },
+        pricing_grain(points));
+}
@@ -0,0 +1,531 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "events.hpp"
+#include "instrument.hpp"
+#include "latency.hpp"
+#include "order_store.hpp"
+
+class order_book {
+  public:
+    // order types and sides
+    enum class order_type : std::uint8_t {
+        market,
+        limit,
+        good_till_canceled,
+        // fills completely on arrival or not at all, never rests
+        for_or_kill_limit,
+        // fills what it can on arrival, the rest is canceled
+        immediate_or_cancel
+    };
+    enum class side : std::uint8_t { buy, sell };
+
+    // order class representing individual orders, price in ticks and
+    // quantity in lots of the book's instrument
+    class order {
+      public:
+        // default constructor
+        order(order_id_t id, order_type type, side _side, price_t price,
+              quantity_t quantity)
+            : id(id), quantity(quantity), price(price), type(type),
+              _side(_side) {}
+
+        // getter functions for order attributes
+        order_id_t get_id() const { return id; }
+        order_type get_type() const { return type; }
+        side get_side() const { return _side; }
+        price_t get_price() const { return price; }
+        quantity_t get_quantity() const { return quantity; }
+
+        // to update order quantity
+        void set_quantity(quantity_t new_quantity) { quantity = new_quantity; }
+
+      private:
+        // largest fields first so the order packs into 24 bytes
+        order_id_t id;
+        quantity_t quantity;
+        price_t price;
+        order_type type;
+        side _side;
+    };
+
+    // expected_orders sizes the order pool and id index up front so the
+    // book does not allocate while it is running
+    explicit order_book(const instrument &inst = instrument{},
+                        size_t expected_orders = 1 << 16)
+        : inst(inst), pool(expected_orders), index(expected_orders),
+          bids(true, inst.ladder_span, inst.price_band),
+          asks(false, inst.ladder_span, inst.price_band) {}
+
+    order_book(const order_book &) = delete;
+    order_book &operator=(const order_book &) = delete;
+
+    const instrument &get_instrument() const { return inst; }
+
+    // acks, fills, cancels and rejects go to the sink, nullptr turns
+    // reporting off
+    void set_event_sink(event_sink *sink) { events = sink; }
+
+    // one depth_update per price level whose aggregated quantity or order
+    // count changed, nullptr turns the L2 stream off
+    void set_depth_sink(depth_sink *sink) { depth = sink; }
+
+    // to add an order to the order book
+    // the order is matched against the opposite side first (price-time
+    // priority) and can fill across several levels and resting orders.
+    // limit and good till canceled orders rest whatever is left. market and
+    // immediate or cancel orders never rest, their remainder is canceled.
+    // fill or kill orders are checked against the aggregated depth first and
+    // canceled untouched when it cannot fill them in full. limit prices
+    // outside the instrument's price band are rejected up front.
+    void add_order(const order &incoming) {
+        latency_scope timed(latency_point::book_add);
+        if (reject_reason reason = entry_check(incoming); reason != reject_reason::none) {
+            emit(event_type::reject, incoming, reason);
+            return;
+        }
+        emit(event_type::ack, incoming);
+        if (incoming.get_type() == order_type::for_or_kill_limit &&
+            !fillable(incoming)) {
+            emit(event_type::cancel, incoming);
+            return;
+        }
+        order o = incoming;
+        match(o, o.get_side() == side::buy ? asks : bids);
+        if (o.get_quantity() == 0) {
+            return;
+        }
+        if (!rests(o.get_type())) {
+            emit(event_type::cancel, o);
+            return;
+        }
+        rest(o);
+    }
+
+    // can the opposite side fill the whole order within its limit price.
+    // only the levels the order would trade through are visited, each for
+    // one read of its aggregated quantity: the walk stops once the
+    // quantity is covered, at the first price that does not cross, or
+    // after the last level of that side when the book is too thin.
+    bool fillable(const order &o) const {
+        quantity_t needed = o.get_quantity();
+        auto take = [&](price_t price, const price_level &level) {
+            if (!crosses(o, price)) {
+                return false;
+            }
+            needed -= level.quantity;
+            return needed > 0;
+        };
+        if (o.get_side() == side::buy) {
+            asks.for_each(take);
+        } else {
+            bids.for_each(take);
+        }
+        return needed <= 0;
+    }
+
+    bool cancel_order(order_id_t order_id) {
+        latency_scope timed(latency_point::book_cancel);
+        slot_t slot = index.find(order_id);
+        if (slot == null_slot) {
+            emit_unknown(order_id);
+            return false;
+        }
+        emit(event_type::cancel, pool[slot].o);
+        unlink(slot);
+        return true;
+    }
+
+    // to reduce the open quantity of a resting order in place, it keeps its
+    // time priority. reducing to zero cancels the order, increasing is not
+    // allowed (that needs a cancel-replace)
+    bool reduce_order(order_id_t order_id, quantity_t new_quantity) {
+        slot_t slot = index.find(order_id);
+        if (slot == null_slot) {
+            emit_unknown(order_id);
+            return false;
+        }
+        order &o = pool[slot].o;
+        if (new_quantity < 0 || new_quantity > o.get_quantity()) {
+            emit(event_type::reject, o, reject_reason::invalid_quantity);
+            return false;
+        }
+        if (new_quantity == o.get_quantity()) {
+            return true;
+        }
+        if (new_quantity == 0) {
+            emit(event_type::cancel, o);
+            unlink(slot);
+            return true;
+        }
+        price_level &level = ladder(o.get_side()).at(o.get_price());
+        level.quantity -= o.get_quantity() - new_quantity;
+        o.set_quantity(new_quantity);
+        publish_level(o.get_side(), o.get_price(), level);
+        return true;
+    }
+
+    // to cancel a resting order and enter a new one in its place, the
+    // replacement goes to the back of the queue and can trade on entry. it
+    // has to be on the same side and could enter the book on its own (its id
+    // may be the one it replaces), otherwise it is rejected and the original
+    // keeps resting untouched.
+    bool replace_order(order_id_t order_id, const order &replacement) {
+        slot_t slot = index.find(order_id);
+        if (slot == null_slot) {
+            emit_unknown(order_id);
+            return false;
+        }
+        reject_reason reason = replacement.get_side() == pool[slot].o.get_side()
+                                   ? entry_check(replacement, slot)
+                                   : reject_reason::side_mismatch;
+        if (reason != reject_reason::none) {
+            emit(event_type::reject, replacement, reason);
+            return false;
+        }
+        emit(event_type::cancel, pool[slot].o);
+        unlink(slot);
+        add_order(replacement);
+        return true;
+    }
+
+    // to change price and/or quantity of a resting order the way a venue
+    // does: a size reduction at the same price keeps queue position, anything
+    // else is a cancel-replace with the same id, side and type. a change the
+    // replacement would be rejected for returns false and leaves the order.
+    bool modify_order(order_id_t order_id, price_t new_price,
+                      quantity_t new_quantity) {
+        slot_t slot = index.find(order_id);
+        if (slot == null_slot) {
+            emit_unknown(order_id);
+            return false;
+        }
+        const order &o = pool[slot].o;
+        if (new_price == o.get_price() && new_quantity <= o.get_quantity()) {
+            return reduce_order(order_id, new_quantity);
+        }
+        return replace_order(order_id, order(order_id, o.get_type(), o.get_side(),
+                                             new_price, new_quantity));
+    }
+
+    // best bid / ask in ticks, empty when that side of the book has no orders
+    std::optional<price_t> best_bid() const {
+        if (bids.empty()) {
+            return std::nullopt;
+        }
+        return bids.best();
+    }
+    std::optional<price_t> best_ask() const {
+        if (asks.empty()) {
+            return std::nullopt;
+        }
+        return asks.best();
+    }
+
+    // aggregated view of one price level
+    struct book_level {
+        price_t price;
+        quantity_t quantity;
+        std::uint32_t orders;
+    };
+
+    // best level of each side, quantity 0 when that side is empty. read
+    // straight from the maintained levels, nothing is recomputed.
+    struct top_of_book {
+        book_level bid;
+        book_level ask;
+    };
+
+    top_of_book top() const {
+        top_of_book t{};
+        if (!bids.empty()) {
+            t.bid = level_info(bids.best(), bids.at(bids.best()));
+        }
+        if (!asks.empty()) {
+            t.ask = level_info(asks.best(), asks.at(asks.best()));
+        }
+        return t;
+    }
+
+    // up to `levels` best levels of each side, best first. cost is the
+    // number of levels copied (plus any empty ticks between them), the
+    // vectors are cleared but keep their capacity so callers can reuse them
+    void depth_snapshot(size_t levels, std::vector<book_level> &bid_levels,
+                        std::vector<book_level> &ask_levels) const {
+        auto collect = [levels](std::vector<book_level> &out) {
+            out.clear();
+            return [&out, levels](price_t price, const price_level &level) {
+                if (out.size() == levels) {
+                    return false;
+                }
+                out.push_back(level_info(price, level));
+                return out.size() < levels;
+            };
+        };
+        bids.for_each(collect(bid_levels));
+        asks.for_each(collect(ask_levels));
+    }
+
+    // number of resting orders
+    size_t size() const { return index.size(); }
+
+    // visit every resting order, bids then asks, best level first and in
+    // time priority inside a level. f(order) returns nothing.
+    template <class F> void for_each_order(F &&f) const {
+        auto visit_level = [this, &f](price_t, const price_level &level) {
+            for (slot_t s = level.head; s != null_slot; s = pool[s].next) {
+                f(pool[s].o);
+            }
+            return true;
+        };
+        bids.for_each(visit_level);
+        asks.for_each(visit_level);
+    }
+
+    // put an order straight at the back of its level, no matching and no
+    // events, only the depth update. for rebuilding a book from a snapshot,
+    // where the orders of a level come oldest first and never cross.
+    // returns false for an empty order, a side or type that cannot rest, a
+    // price outside the band or an id that is already resting.
+    bool restore_order(const order &o) {
+        if (o.get_quantity() <= 0 || o.get_side() > side::sell || !rests(o.get_type()) ||
+            !in_band(o) || index.find(o.get_id()) != null_slot) {
+            return false;
+        }
+        rest(o);
+        return true;
+    }
+
+    // to print all orders in the order book, best levels first and in time
+    // priority inside a level
+    void print_orders() const {
+        auto print_level = [this](price_t, const price_level &level) {
+            for (slot_t s = level.head; s != null_slot; s = pool[s].next) {
+                print_order(pool[s].o);
+            }
+            return true;
+        };
+        asks.for_each(print_level);
+        bids.for_each(print_level);
+    }
+
+  private:
+    // orders resting at one price as an intrusive FIFO through the pool,
+    // head is the oldest (first to fill)
+    struct price_level {
+        slot_t head{null_slot};
+        slot_t tail{null_slot};
+        quantity_t quantity{0};
+        std::uint32_t count{0};
+    };
+
+    // an order in the pool, linked into its level. the level is found from
+    // the price so the node fits in half a cache line.
+    struct order_node {
+        order o{0, order_type::limit, side::buy, 0, 0};
+        slot_t prev{null_slot};
+        slot_t next{null_slot};
+    };
+    static_assert(sizeof(order_node) == 32);
+
+    instrument inst;
+    event_sink *events{nullptr};
+    depth_sink *depth{nullptr};
+    order_pool<order_node> pool;
+    order_index<order_id_t> index;
+    // bids best = highest price, asks best = lowest price
+    price_ladder<price_level> bids;
+    price_ladder<price_level> asks;
+
+    price_ladder<price_level> &ladder(side s) {
+        return s == side::buy ? bids : asks;
+    }
+
+    static book_level level_info(price_t price, const price_level &level) {
+        return book_level{price, level.quantity, level.count};
+    }
+
+    void publish_level(side s, price_t price, const price_level &level) {
+        if (depth) {
+            depth->publish(depth_update{
+                level.quantity, price, level.count,
+                level.count ? depth_update_type::changed : depth_update_type::removed,
+                static_cast<std::uint8_t>(s)});
+        }
+    }
+
+    // why an order cannot enter the book, none when it can. replaces is the
+    // slot of the resting order it takes the place of, whose id it may reuse.
+    reject_reason entry_check(const order &o, slot_t replaces = null_slot) const {
+        if (o.get_quantity() <= 0) {
+            return reject_reason::invalid_quantity;
+        }
+        if (!in_band(o)) {
+            return reject_reason::price_out_of_band;
+        }
+        slot_t existing = index.find(o.get_id());
+        if (existing != null_slot && existing != replaces) {
+            return reject_reason::duplicate_id;
+        }
+        return reject_reason::none;
+    }
+
+    // market orders carry no price, everything else could rest at its own
+    bool in_band(const order &o) const {
+        return o.get_type() == order_type::market ||
+               (o.get_side() == side::buy ? bids : asks).fits(o.get_price());
+    }
+
+    static bool rests(order_type type) {
+        return type == order_type::limit || type == order_type::good_till_canceled;
+    }
+
+    // does the incoming order trade with a resting level at this price
+    static bool crosses(const order &o, price_t level_price) {
+        if (o.get_type() == order_type::market) {
+            return true;
+        }
+        return o.get_side() == side::buy ? level_price <= o.get_price()
+                                         : level_price >= o.get_price();
+    }
+
+    // walk the opposite side from the top, filling against each level in
+    // FIFO order until the incoming order is done or stops crossing. only
+    // orders that trade are timed, the rest return before the clock starts.
+    void match(order &o, price_ladder<price_level> &opposite) {
+        if (opposite.empty() || !crosses(o, opposite.best())) {
+            return;
+        }
+        latency_scope timed(latency_point::book_match);
+        while (o.get_quantity() > 0 && !opposite.empty()) {
+            price_t price = opposite.best();
+            if (!crosses(o, price)) {
+                break;
+            }
+            price_level &level = opposite.at(price);
+            while (o.get_quantity() > 0 && level.head != null_slot) {
+                slot_t slot = level.head;
+                order &resting = pool[slot].o;
+                level.quantity -= execute_order(o, resting, price);
+                if (resting.get_quantity() == 0) {
+                    pop_front(level, slot);
+                }
+            }
+            publish_level(o.get_side() == side::buy ? side::sell : side::buy,
+                          price, level);
+            if (level.count == 0) {
+                opposite.deactivate(price);
+            }
+        }
+    }
+
+    void emit(event_type type, const order &o,
+              reject_reason reason = reject_reason::none) {
+        if (events) {
+            events->publish(event{o.get_id(), 0, o.get_quantity(), o.get_price(),
+                                  type, static_cast<std::uint8_t>(o.get_side()),
+                                  reason});
+        }
+    }
+
+    void emit_unknown(order_id_t order_id) {
+        if (events) {
+            events->publish(event{order_id, 0, 0, 0, event_type::reject, 0,
+                                  reject_reason::unknown_order});
+        }
+    }
+
+    // duplicate ids are rejected before matching so this always succeeds
+    void rest(const order &o) {
+        price_ladder<price_level> &same_side = ladder(o.get_side());
+        price_level &level = same_side.at(o.get_price());
+        slot_t slot = pool.acquire();
+        index.insert(o.get_id(), slot);
+        order_node &node = pool[slot];
+        node.o = o;
+        node.prev = level.tail;
+        node.next = null_slot;
+        if (level.tail != null_slot) {
+            pool[level.tail].next = slot;
+        } else {
+            level.head = slot;
+        }
+        level.tail = slot;
+        level.quantity += o.get_quantity();
+        if (level.count++ == 0) {
+            same_side.activate(o.get_price());
+        }
+        publish_level(o.get_side(), o.get_price(), level);
+    }
+
+    // drop the fully filled head of a level
+    void pop_front(price_level &level, slot_t slot) {
+        order_node &node = pool[slot];
+        level.head = node.next;
+        if (level.head != null_slot) {
+            pool[level.head].prev = null_slot;
+        } else {
+            level.tail = null_slot;
+        }
+        --level.count;
+        index.erase(node.o.get_id());
+        pool.release(slot);
+    }
+
+    // take a resting order out of its level and the book
+    void unlink(slot_t slot) {
+        order_node &node = pool[slot];
+        price_ladder<price_level> &same_side = ladder(node.o.get_side());
+        price_level &level = same_side.at(node.o.get_price());
+        if (node.prev != null_slot) {
+            pool[node.prev].next = node.next;
+        } else {
+            level.head = node.next;
+        }
+        if (node.next != null_slot) {
+            pool[node.next].prev = node.prev;
+        } else {
+            level.tail = node.prev;
+        }
+        level.quantity -= node.o.get_quantity();
+        if (--level.count == 0) {
+            same_side.deactivate(node.o.get_price());
+        }
+        publish_level(node.o.get_side(), node.o.get_price(), level);
+        index.erase(node.o.get_id());
+        pool.release(slot);
+    }
+
+    // helper function to execute an order, fills the smaller of the two
+    // quantities at the resting order's price and returns the fill size
+    quantity_t execute_order(order &incoming, order &resting, price_t fill_price) {
+        quantity_t fill_quantity =
+            std::min(incoming.get_quantity(), resting.get_quantity());
+        if (events) {
+            events->publish(event{incoming.get_id(), resting.get_id(), fill_quantity,
+                                  fill_price, event_type::fill,
+                                  static_cast<std::uint8_t>(incoming.get_side()),
+                                  reject_reason::none});
+        }
+        incoming.set_quantity(incoming.get_quantity() - fill_quantity);
+        resting.set_quantity(resting.get_quantity() - fill_quantity);
+        return fill_quantity;
+    }
+
+    // helper function to print an individual order, debugging only so it
+    // writes straight to std::cout
+    void print_order(const order &order) const {
+        std::cout << "Order ID: " << order.get_id()
+                  << ", Type: " << static_cast<int>(order.get_type())
+                  << ", Side: " << (order.get_side() == side::buy ? "Buy" : "Sell")
+                  << ", Price: " << std::fixed << std::setprecision(2)
+                  << inst.to_price(order.get_price())
+                  << ", Quantity: " << order.get_quantity() << '\n';
+    }
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "instrument.hpp"
+
+// index of an order inside an order_pool, stays valid for the order's whole
+// life so it can be used as an intrusive link
+using slot_t = std::uint32_t;
+constexpr slot_t null_slot = UINT32_MAX;
+
+// slab of orders with an intrusive free list. slots are handed out from the
+// preallocated storage and recycled on release, so once the pool has warmed
+// up add/cancel never touch the heap. T needs a `next` slot member, the free
+// list reuses it.
+template <class T> class order_pool {
+  public:
+    explicit order_pool(size_t capacity) { nodes.reserve(capacity); }
+
+    slot_t acquire() {
+        if (free_head != null_slot) {
+            slot_t slot = free_head;
+            free_head = nodes[slot].next;
+            return slot;
+        }
+        // only grows past the reserved capacity, slots stay valid since they
+        // are indices and not pointers
+        nodes.emplace_back();
+        return static_cast<slot_t>(nodes.size() - 1);
+    }
+
+    void release(slot_t slot) {
+        nodes[slot].next = free_head;
+        free_head = slot;
+    }
+
+    T &operator[](slot_t slot) { return nodes[slot]; }
+    const T &operator[](slot_t slot) const { return nodes[slot]; }
+
+  private:
+    std::vector<T> nodes;
+    slot_t free_head{null_slot};
+};
+
+// flat open addressing map from order id to pool slot. linear probing over a
+// power of two table, erase shifts the following entries back so there are
+// no tombstones and lookups never degrade after heavy cancel churn.
+template <class key_t> class order_index {
+  public:
+    explicit order_index(size_t expected) {
+        size_t capacity = 16;
+        while (capacity < expected * 2) {
+            capacity <<= 1;
+        }
+        entries.assign(capacity, entry{});
+        mask = capacity - 1;
+    }
+
+    slot_t find(key_t id) const {
+        for (size_t i = home(id);; i = (i + 1) & mask) {
+            const entry &e = entries[i];
+            if (e.slot == null_slot) {
+                return null_slot;
+            }
+            if (e.id == id) {
+                return e.slot;
+            }
+        }
+    }
+
+    // returns false if the id is already present
+    bool insert(key_t id, slot_t slot) {
+        if ((count + 1) * 2 > entries.size()) {
+            grow();
+        }
+        for (size_t i = home(id);; i = (i + 1) & mask) {
+            entry &e = entries[i];
+            if (e.slot == null_slot) {
+                e = entry{id, slot};
+                ++count;
+                return true;
+            }
+            if (e.id == id) {
+                return false;
+            }
+        }
+    }
+
+    bool erase(key_t id) {
+        size_t i = home(id);
+        while (true) {
+            if (entries[i].slot == null_slot) {
+                return false;
+            }
+            if (entries[i].id == id) {
+                break;
+            }
+            i = (i + 1) & mask;
+        }
+        // backward shift: pull later entries of the probe run into the hole
+        // unless they already sit at or after their home position
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; entries[j].slot != null_slot;
+             j = (j + 1) & mask) {
+            size_t h = home(entries[j].id);
+            bool movable = hole <= j ? (h <= hole || h > j) : (h <= hole && h > j);
+            if (movable) {
+                entries[hole] = entries[j];
+                hole = j;
+            }
+        }
+        entries[hole] = entry{};
+        --count;
+        return true;
+    }
+
+    size_t size() const { return count; }
+
+  private:
+    struct entry {
+        key_t id{};
+        slot_t slot{null_slot};
+    };
+
+    std::vector<entry> entries;
+    size_t mask{0};
+    size_t count{0};
+
+    // fibonacci hashing, spreads sequential ids over the table
+    size_t home(key_t id) const {
+        return static_cast<size_t>(
+                   (static_cast<std::uint64_t>(id) * 0x9E3779B97F4A7C15ull) >> 32) &
+               mask;
+    }
+
+    void grow() {
+        std::vector<entry> old;
+        old.swap(entries);
+        entries.assign(old.size() * 2, entry{});
+        mask = entries.size() - 1;
+        count = 0;
+        for (const entry &e : old) {
+            if (e.slot != null_slot) {
+                insert(e.id, e.slot);
+            }
+        }
+    }
+};
+
+// one side of the book as a flat array of levels indexed by tick. the window
+// covers `span` ticks either side of the first price seen and only grows
+// (the one allocation) when an order lands outside it. the best price is kept
+// incrementally, when the best level empties the next one is found by walking
+// away from the spread, which only touches the gap between two levels.
+// level_t needs a `count` member, zero meaning the level is empty.
+template <class level_t> class price_ladder {
+  public:
+    // descending is true for bids, where the higher price is better. the
+    // window never grows past max_levels ticks.
+    price_ladder(bool descending, price_t span, price_t max_levels)
+        : descending(descending), span(span),
+          max_levels(std::max<std::int64_t>(max_levels, 2 * std::int64_t{span} + 1)) {}
+
+    bool empty() const { return active == 0; }
+    price_t best() const { return best_price; }
+
+    // can at(price) be called: the price is inside the window, or the
+    // window can grow to it without passing max_levels ticks or leaving
+    // the range of price_t
+    bool fits(price_t price) const {
+        std::int64_t lo = std::int64_t{price} - span;
+        std::int64_t hi = std::int64_t{price} + span + 1;
+        if (!levels.empty()) {
+            std::int64_t end = std::int64_t{base} + static_cast<std::int64_t>(levels.size());
+            if (price >= base && price < end) {
+                return true;
+            }
+            lo = std::min<std::int64_t>(lo, base);
+            hi = std::max(hi, end);
+        }
+        return hi - lo <= max_levels && lo >= std::numeric_limits<price_t>::min() &&
+               hi <= std::numeric_limits<price_t>::max();
+    }
+
+    // level at a price, extending the window if needed. the price has to
+    // fit(), the book checks that before an order rests.
+    level_t &at(price_t price) {
+        if (levels.empty() || price < base ||
+            price >= base + static_cast<price_t>(levels.size())) {
+            grow(price);
+        }
+        return levels[price - base];
+    }
+    const level_t &at(price_t price) const { return levels[price - base]; }
+
+    // to be called when the level at price goes from empty to non empty
+    void activate(price_t price) {
+        if (active++ == 0 || better(price, best_price)) {
+            best_price = price;
+        }
+    }
+
+    // to be called when the level at price has just become empty
+    void deactivate(price_t price) {
+        if (--active == 0 || price != best_price) {
+            return;
+        }
+        price_t step = descending ? -1 : 1;
+        do {
+            best_price += step;
+        } while (levels[best_price - base].count == 0);
+    }
+
+    // visit the non empty levels from best to worst, f returns false to
+    // stop. the walk ends at the last non empty level, so the cost is the
+    // levels visited plus the empty ticks between them, never the window.
+    template <class F> void for_each(F &&f) const {
+        price_t step = descending ? -1 : 1;
+        size_t remaining = active;
+        for (price_t p = best_price; remaining > 0; p += step) {
+            const level_t &level = levels[p - base];
+            if (level.count == 0) {
+                continue;
+            }
+            if (!f(p, level)) {
+                return;
+            }
+            --remaining;
+        }
+    }
+
+  private:
+    std::vector<level_t> levels;
+    price_t base{0};
+    bool descending;
+    price_t span;
+    std::int64_t max_levels;
+    size_t active{0};
+    price_t best_price{0};
+
+    bool better(price_t a, price_t b) const {
+        return descending ? a > b : a < b;
+    }
+
+    void grow(price_t price) {
+        if (levels.empty()) {
+            base = price - span;
+            levels.assign(2 * static_cast<size_t>(span) + 1, level_t{});
+            return;
+        }
+        price_t end = base + static_cast<price_t>(levels.size());
+        price_t new_base = std::min(base, price - span);
+        price_t new_end = std::max(end, price + span + 1);
+        std::vector<level_t> wider(static_cast<size_t>(new_end - new_base));
+        std::copy(levels.begin(), levels.end(), wider.begin() + (base - new_base));
+        levels.swap(wider);
+        base = new_base;
+    }
+};
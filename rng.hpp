@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// fast non-cryptographic generators for the monte carlo code. all of them
+// are plain integer arithmetic with no branches, so the lane version below
+// vectorizes into SIMD shifts, xors and adds.
+
+// expands a seed into generator state, every call advances state
+inline std::uint64_t splitmix64(std::uint64_t &state) {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// top 52 bits of x as a double in [0, 1). built from the bits directly
+// instead of an int to double conversion, which SSE/AVX2 cannot vectorize.
+inline double to_unit_double(std::uint64_t x) {
+    return std::bit_cast<double>((x >> 12) | 0x3FF0000000000000ull) - 1.0;
+}
+
+// xoshiro256+ (Blackman and Vigna), the variant meant for floating point
+// output: the low bits are weak but to_unit_double throws them away
+class xoshiro256plus {
+  public:
+    explicit xoshiro256plus(std::uint64_t seed) {
+        for (auto &word : s) {
+            word = splitmix64(seed);
+        }
+    }
+
+    std::uint64_t next() {
+        std::uint64_t result = s[0] + s[3];
+        std::uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = std::rotl(s[3], 45);
+        return result;
+    }
+
+    double next_double() { return to_unit_double(next()); }
+
+  private:
+    std::uint64_t s[4];
+};
+
+// `lanes` independent xoshiro256+ generators stepped together. the state is
+// stored lane-major (one array per state word) so each step is a handful of
+// full-width vector operations, 8 lanes fill one AVX-512 or two AVX2
+// registers.
+template <size_t lanes = 8> class xoshiro_lanes {
+  public:
+    static constexpr size_t width = lanes;
+
+    explicit xoshiro_lanes(std::uint64_t seed) {
+        for (size_t i = 0; i < lanes; ++i) {
+            s0[i] = splitmix64(seed);
+            s1[i] = splitmix64(seed);
+            s2[i] = splitmix64(seed);
+            s3[i] = splitmix64(seed);
+        }
+    }
+
+    // n uniform doubles in [0, 1), n must be a multiple of width
+    void fill(double *out, size_t n) {
+        for (size_t base = 0; base < n; base += lanes) {
+            for (size_t i = 0; i < lanes; ++i) {
+                std::uint64_t result = s0[i] + s3[i];
+                std::uint64_t t = s1[i] << 17;
+                s2[i] ^= s0[i];
+                s3[i] ^= s1[i];
+                s1[i] ^= s2[i];
+                s0[i] ^= s3[i];
+                s2[i] ^= t;
+                s3[i] = (s3[i] << 45) | (s3[i] >> 19);
+                out[base + i] = to_unit_double(result);
+            }
+        }
+    }
+
+  private:
+    alignas(64) std::uint64_t s0[lanes];
+    alignas(64) std::uint64_t s1[lanes];
+    alignas(64) std::uint64_t s2[lanes];
+    alignas(64) std::uint64_t s3[lanes];
+};
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"). a counter based generator: the output is a pure function of a 128 bit
+// counter and a 64 bit key, there is no state to advance.
+inline void philox4x32_10(std::uint32_t c[4], std::uint32_t k0, std::uint32_t k1) {
+    for (int round = 0; round < 10; ++round) {
+        std::uint64_t p0 = std::uint64_t{0xD2511F53u} * c[0];
+        std::uint64_t p1 = std::uint64_t{0xCD9E8D57u} * c[2];
+        std::uint32_t n0 = static_cast<std::uint32_t>(p1 >> 32) ^ c[1] ^ k0;
+        std::uint32_t n2 = static_cast<std::uint32_t>(p0 >> 32) ^ c[3] ^ k1;
+        c[0] = n0;
+        c[1] = static_cast<std::uint32_t>(p1);
+        c[2] = n2;
+        c[3] = static_cast<std::uint32_t>(p0);
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+// substream `stream` of a master seed with random access: counter words 0
+// and 1 are the index, words 2 and 3 the stream id, and every index gets 128
+// random bits. creating one is free and index i is the same number no matter
+// which thread asks for it.
+class philox_stream {
+  public:
+    philox_stream(std::uint64_t seed, std::uint64_t stream)
+        : k0(static_cast<std::uint32_t>(seed)), k1(static_cast<std::uint32_t>(seed >> 32)),
+          s0(static_cast<std::uint32_t>(stream)), s1(static_cast<std::uint32_t>(stream >> 32)) {}
+
+    // the 128 random bits of `index` as two 64 bit words
+    void bits(std::uint64_t index, std::uint64_t &a, std::uint64_t &b) const {
+        std::uint32_t c[4] = {static_cast<std::uint32_t>(index),
+                              static_cast<std::uint32_t>(index >> 32), s0, s1};
+        philox4x32_10(c, k0, k1);
+        a = c[0] | (std::uint64_t{c[1]} << 32);
+        b = c[2] | (std::uint64_t{c[3]} << 32);
+    }
+
+  private:
+    std::uint32_t k0, k1;
+    std::uint32_t s0, s1;
+};
+
+// reproducible bulk sampling. the samples of a stream are cut into fixed
+// blocks, block b is drawn by xoshiro lanes keyed from philox(seed, stream,
+// b), and each sample is a pair of uniforms (u, v). sample i is therefore a
+// fixed function of (seed, stream, i): any split of the index range over any
+// number of threads draws the exact same numbers, while the bulk of the work
+// runs at xoshiro speed. a range that starts or ends inside a block pays
+// for generating that one block in full.
+class block_stream {
+  public:
+    static constexpr size_t block_size = 1024;
+
+    block_stream(std::uint64_t seed, std::uint64_t stream) : keys(seed, stream) {}
+
+    // the generator of block b, it yields the block's u values followed by
+    // its v values
+    xoshiro_lanes<> block(std::uint64_t b) const {
+        std::uint64_t a, c;
+        keys.bits(b, a, c);
+        return xoshiro_lanes<>(a ^ std::rotl(c, 29));
+    }
+
+    // u and v for samples [first, first + n)
+    void fill(std::uint64_t first, size_t n, double *u, double *v) const {
+        while (n > 0) {
+            std::uint64_t b = first / block_size;
+            size_t offset = static_cast<size_t>(first % block_size);
+            size_t count = std::min(n, block_size - offset);
+            xoshiro_lanes<> gen = block(b);
+            if (count == block_size) {
+                gen.fill(u, block_size);
+                gen.fill(v, block_size);
+            } else {
+                alignas(64) double tmp[block_size];
+                gen.fill(tmp, block_size);
+                std::copy(tmp + offset, tmp + offset + count, u);
+                gen.fill(tmp, block_size);
+                std::copy(tmp + offset, tmp + offset + count, v);
+            }
+            u += count;
+            v += count;
+            first += count;
+            n -= count;
+        }
+    }
+
+  private:
+    philox_stream keys;
+};
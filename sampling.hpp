@@ -0,0 +1,568 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "monte_carlo.hpp"
+#include "rng.hpp"
+
+// sampling modes for the monte carlo estimators. a point_set hands out the
+// coordinates of points in the unit cube, the estimators turn points into
+// samples (a hit count, a path) and never care how the points were made.
+//
+//   pseudo      independent uniforms from block_stream
+//   antithetic  every odd point is the mirror image 1 - u of the one before
+//   stratified  each pair of dimensions is cut into a grid with one jittered
+//               point per cell, the cells are visited in a different
+//               shuffled order for every pair
+//   sobol       Owen scrambled Sobol' points, up to 64 dimensions
+//   halton      Halton points with random digit permutations, up to 64
+//               dimensions
+//
+// points come in groups of group_size(): an antithetic pair, one pass over
+// the strata, one scrambled net. points inside a group are dependent, that
+// is the whole trick, but groups are independent copies of each other, so
+// an estimator averages each group into one observation and running_stats
+// over the observations gives an honest error bar. the quasi random sets
+// are randomized quasi monte carlo: every group is the first group_size()
+// points of the sequence under its own random scramble.
+//
+// like block_stream, coordinate d of point i depends only on the seed, d and
+// i, so any split of the points over any number of threads draws the same
+// points.
+//
+// control variates work at the estimator level instead: an estimator that
+// also knows a quantity c with known mean reports f - beta (c - E[c]),
+// see control_variate.
+
+enum class sampling_mode : std::uint8_t { pseudo, antithetic, stratified, sobol, halton };
+
+// primitive polynomial x^degree + a_1 x^(degree - 1) + ... + 1 over GF(2),
+// the middle coefficients packed into a with a_1 the most significant bit
+inline bool primitive_polynomial(unsigned degree, std::uint32_t a) {
+    std::uint32_t poly = (1u << degree) | (a << 1) | 1u;
+    std::uint32_t period = (1u << degree) - 1;
+    // primitive iff x has multiplicative order 2^degree - 1
+    std::uint32_t x = 1;
+    for (std::uint32_t k = 1; k <= period; ++k) {
+        x <<= 1;
+        if (x >> degree & 1) {
+            x ^= poly;
+        }
+        if (x == 1) {
+            return k == period;
+        }
+    }
+    return false;
+}
+
+constexpr size_t sobol_dimensions = 64;
+
+// direction numbers of the first sobol_dimensions Sobol' dimensions, 32
+// bits each with bit 31 the first binary digit
+inline const std::array<std::array<std::uint32_t, 32>, sobol_dimensions> &sobol_directions() {
+    static const auto table = [] {
+        // initial numbers m_1..m_s of dimensions 2 to 21 from Joe and Kuo's
+        // new-joe-kuo-6.21201, chosen for good two dimensional projections
+        constexpr std::uint32_t joe_kuo[][7] = {
+            {1},
+            {1, 3},
+            {1, 3, 1},
+            {1, 1, 1},
+            {1, 1, 3, 3},
+            {1, 3, 5, 13},
+            {1, 1, 5, 5, 17},
+            {1, 1, 5, 5, 5},
+            {1, 1, 7, 11, 19},
+            {1, 1, 5, 1, 1},
+            {1, 1, 1, 3, 11},
+            {1, 3, 5, 5, 31},
+            {1, 3, 3, 9, 7, 49},
+            {1, 1, 1, 15, 21, 21},
+            {1, 3, 1, 13, 27, 49},
+            {1, 1, 1, 15, 7, 5},
+            {1, 3, 1, 15, 13, 25},
+            {1, 1, 5, 5, 19, 61},
+            {1, 3, 7, 11, 23, 15, 103},
+            {1, 3, 7, 13, 13, 15, 69},
+        };
+        constexpr size_t tabulated = std::size(joe_kuo);
+
+        std::array<std::array<std::uint32_t, 32>, sobol_dimensions> v{};
+        // the first dimension is the van der Corput sequence
+        for (unsigned b = 0; b < 32; ++b) {
+            v[0][b] = 1u << (31 - b);
+        }
+        // one primitive polynomial per further dimension, taken in order of
+        // degree and then coefficients, which is the order of the table.
+        // past the table the initial numbers are drawn at random (any odd
+        // m_k < 2^k gives a valid sequence, the scrambling hides the rest).
+        std::uint64_t state = 0x50B01D1Eull;
+        size_t d = 1;
+        for (unsigned degree = 1; d < sobol_dimensions; ++degree) {
+            for (std::uint32_t a = 0; a < (1u << (degree - 1)) && d < sobol_dimensions; ++a) {
+                if (!primitive_polynomial(degree, a)) {
+                    continue;
+                }
+                for (unsigned b = 0; b < degree; ++b) {
+                    std::uint32_t m = d <= tabulated
+                                          ? joe_kuo[d - 1][b]
+                                          : static_cast<std::uint32_t>(splitmix64(state) % (1u << b)) * 2 + 1;
+                    v[d][b] = m << (31 - b);
+                }
+                for (unsigned b = degree; b < 32; ++b) {
+                    std::uint32_t x = v[d][b - degree] ^ (v[d][b - degree] >> degree);
+                    for (unsigned k = 1; k < degree; ++k) {
+                        if (a >> (degree - 1 - k) & 1) {
+                            x ^= v[d][b - k];
+                        }
+                    }
+                    v[d][b] = x;
+                }
+                ++d;
+            }
+        }
+        return v;
+    }();
+    return table;
+}
+
+inline std::uint32_t reverse_bits(std::uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// nested uniform (Owen) scramble of a 32 bit binary fraction, the hash
+// based version of Burley, "Practical hash-based Owen scrambling". on the
+// reversed bits every step only lets a bit change the bits above it, so
+// each output digit depends on the key and the digits before it: a
+// scrambled net is still a net.
+inline std::uint32_t owen_scramble(std::uint32_t x, std::uint32_t key) {
+    x = reverse_bits(x);
+    x ^= x * 0x3D20ADEAu;
+    x += key;
+    x *= (key >> 16) | 1u;
+    x ^= x * 0x05526C56u;
+    x ^= x * 0x53A22864u;
+    return reverse_bits(x);
+}
+
+// keyed permutation of [0, mask], mask + 1 a power of two (Kensler,
+// "Correlated multi-jittered sampling"). every step is invertible on the
+// low bits.
+inline std::uint32_t shuffle_index(std::uint32_t i, std::uint32_t mask, std::uint32_t key) {
+    i ^= key;
+    i *= 0xE170893Du;
+    i ^= key >> 16;
+    i ^= (i & mask) >> 4;
+    i ^= key >> 8;
+    i *= 0x0929EB3Fu;
+    i ^= key >> 23;
+    i ^= (i & mask) >> 1;
+    i *= 1u | key >> 27;
+    i *= 0x6935FA69u;
+    i ^= (i & mask) >> 11;
+    i *= 0x74DCB303u;
+    i ^= (i & mask) >> 2;
+    i *= 0x9E501CC3u;
+    i ^= (i & mask) >> 2;
+    i *= 0xC860A3DFu;
+    i &= mask;
+    i ^= i >> 5;
+    return (i + key) & mask;
+}
+
+constexpr size_t halton_dimensions = 64;
+
+// the first halton_dimensions primes, one base per dimension
+constexpr std::array<std::uint32_t, halton_dimensions> halton_bases = [] {
+    std::array<std::uint32_t, halton_dimensions> primes{};
+    size_t found = 0;
+    for (std::uint32_t n = 2; found < halton_dimensions; ++n) {
+        bool prime = true;
+        for (size_t k = 0; k < found && primes[k] * primes[k] <= n; ++k) {
+            prime = prime && n % primes[k] != 0;
+        }
+        if (prime) {
+            primes[found++] = n;
+        }
+    }
+    return primes;
+}();
+
+// key for scrambling `dimension` of group `group`
+inline std::uint64_t scramble_key(std::uint64_t seed, std::uint64_t group, std::uint64_t dimension) {
+    std::uint64_t state = seed ^ (group * 0xD1B54A32D192ED03ull) ^ (dimension * 0x8CB92BA72F3D8DD7ull);
+    splitmix64(state);
+    return splitmix64(state);
+}
+
+// u in (0, 1) from a 32 bit binary fraction, the midpoint of its cell.
+// through the mantissa bits like to_unit_double, so it vectorizes.
+inline double fraction_to_unit(std::uint32_t x) {
+    return std::bit_cast<double>(0x3FF0000000000000ull | (std::uint64_t{x} << 20)) - (1.0 - 0x1p-33);
+}
+
+class point_set {
+  public:
+    // the largest group; Halton digit tables are sized for it
+    static constexpr size_t max_group_size = size_t{1} << 20;
+
+    // group_size is rounded up to a power of two, zero picks the mode's
+    // default. pseudo points always come one per group and antithetic ones
+    // in pairs.
+    point_set(sampling_mode mode, std::uint64_t seed, size_t group_size = 0)
+        : kind(mode), seed(seed) {
+        size_t size = group_size;
+        if (mode == sampling_mode::pseudo) {
+            size = 1;
+        } else if (mode == sampling_mode::antithetic) {
+            size = 2;
+        } else if (size == 0) {
+            size = mode == sampling_mode::stratified ? 1024 : 4096;
+        }
+        if (size > max_group_size) {
+            throw std::invalid_argument("point_set group size above max_group_size");
+        }
+        group = std::bit_ceil(size);
+        group_bits = static_cast<unsigned>(std::countr_zero(group));
+    }
+
+    sampling_mode mode() const { return kind; }
+    size_t group_size() const { return group; }
+
+    // number of coordinates a point has
+    size_t dimensions() const {
+        switch (kind) {
+        case sampling_mode::sobol:
+            return sobol_dimensions;
+        case sampling_mode::halton:
+            return halton_dimensions;
+        default:
+            return std::numeric_limits<size_t>::max();
+        }
+    }
+
+    // dimensions 2 pair and 2 pair + 1 of points [first, first + n) into u
+    // and v, every value strictly inside (0, 1)
+    void fill(size_t pair, std::uint64_t first, size_t n, double *u, double *v) const {
+        switch (kind) {
+        case sampling_mode::pseudo:
+            fill_pseudo(pair, first, n, u, v);
+            break;
+        case sampling_mode::antithetic:
+            fill_antithetic(pair, first, n, u, v);
+            break;
+        case sampling_mode::stratified:
+            fill_stratified(pair, first, n, u, v);
+            break;
+        case sampling_mode::sobol:
+            fill_sobol(2 * pair, first, n, u);
+            fill_sobol(2 * pair + 1, first, n, v);
+            break;
+        case sampling_mode::halton:
+            fill_halton(2 * pair, first, n, u);
+            fill_halton(2 * pair + 1, first, n, v);
+            break;
+        }
+    }
+
+  private:
+    sampling_mode kind;
+    std::uint64_t seed;
+    size_t group;
+    unsigned group_bits;
+
+    // block_stream uniforms are multiples of 2^-52 in [0, 1), half a step
+    // up they are symmetric around 1/2, so 1 - u is exact and never 0
+    void fill_pseudo(size_t pair, std::uint64_t first, size_t n, double *u, double *v) const {
+        block_stream(seed, pair).fill(first, n, u, v);
+        for (size_t i = 0; i < n; ++i) {
+            u[i] += 0x1p-53;
+            v[i] += 0x1p-53;
+        }
+    }
+
+    void fill_antithetic(size_t pair, std::uint64_t first, size_t n, double *u, double *v) const {
+        fill_pseudo(pair, first, n, u, v);
+        size_t i = 1;
+        if (first % 2 == 1) {
+            // the range starts on the mirror half of a pair
+            double a, b;
+            fill_pseudo(pair, first - 1, 1, &a, &b);
+            u[0] = 1.0 - a;
+            v[0] = 1.0 - b;
+            i = 2;
+        }
+        for (; i < n; i += 2) {
+            u[i] = 1.0 - u[i - 1];
+            v[i] = 1.0 - v[i - 1];
+        }
+    }
+
+    void fill_stratified(size_t pair, std::uint64_t first, size_t n, double *u, double *v) const {
+        // a columns x rows grid with one cell per point of the group
+        std::uint32_t columns = 1u << ((group_bits + 1) / 2);
+        std::uint32_t rows = 1u << (group_bits / 2);
+        double column_width = 1.0 / columns;
+        double row_height = 1.0 / rows;
+        std::uint32_t mask = static_cast<std::uint32_t>(group - 1);
+        // jitter inside the cell
+        fill_pseudo(pair, first, n, u, v);
+        std::uint64_t current = ~std::uint64_t{0};
+        std::uint32_t key = 0;
+        for (size_t i = 0; i < n; ++i) {
+            std::uint64_t index = first + i;
+            std::uint32_t cell = static_cast<std::uint32_t>(index) & mask;
+            // the first pair walks the cells in order, the others shuffled so
+            // the cell of one pair says nothing about the cell of another
+            if (pair > 0) {
+                if (index >> group_bits != current) {
+                    current = index >> group_bits;
+                    key = static_cast<std::uint32_t>(scramble_key(seed, current, pair));
+                }
+                cell = shuffle_index(cell, mask, key);
+            }
+            u[i] = ((cell & (columns - 1)) + u[i]) * column_width;
+            v[i] = ((cell >> ((group_bits + 1) / 2)) + v[i]) * row_height;
+        }
+    }
+
+    void fill_sobol(size_t dimension, std::uint64_t first, size_t n, double *out) const {
+        const std::array<std::uint32_t, 32> &directions = sobol_directions()[dimension];
+        alignas(64) std::uint32_t raw[block_stream::block_size];
+        while (n > 0) {
+            // up to a block of points from one group
+            std::uint64_t index = first & (group - 1);
+            size_t count = static_cast<size_t>(std::min<std::uint64_t>(
+                {n, group - index, block_stream::block_size}));
+            std::uint32_t key = static_cast<std::uint32_t>(scramble_key(seed, first >> group_bits, dimension));
+            // the first point directly, then one direction number per point:
+            // consecutive gray codes differ in one bit, and in gray code
+            // order any aligned power of two run holds the same points as in
+            // natural order
+            std::uint32_t j = static_cast<std::uint32_t>(index);
+            std::uint32_t gray = j ^ (j >> 1);
+            std::uint32_t x = 0;
+            for (unsigned b = 0; gray != 0; ++b, gray >>= 1) {
+                x ^= (gray & 1) ? directions[b] : 0;
+            }
+            raw[0] = x;
+            for (size_t i = 1; i < count; ++i) {
+                x ^= directions[std::countr_zero(j + static_cast<std::uint32_t>(i))];
+                raw[i] = x;
+            }
+            // the scramble is independent per point
+            if (count == block_stream::block_size) {
+                for (size_t i = 0; i < block_stream::block_size; ++i) {
+                    out[i] = fraction_to_unit(owen_scramble(raw[i], key));
+                }
+            } else {
+                for (size_t i = 0; i < count; ++i) {
+                    out[i] = fraction_to_unit(owen_scramble(raw[i], key));
+                }
+            }
+            out += count;
+            first += count;
+            n -= count;
+        }
+    }
+
+    // digit k of the index in base b is sent through its own random
+    // permutation; digits past the last one a group index can have are
+    // random too, together they are one uniform below b^-digits. the
+    // scrambled contributions of a few digits at a time are tabulated per
+    // group, so a point costs a handful of lookups.
+    void fill_halton(size_t dimension, std::uint64_t first, size_t n, double *out) const {
+        std::uint32_t base = halton_bases[dimension];
+        unsigned digits = 1;
+        double tail_scale = 1.0 / base;
+        for (std::uint64_t reach = base; reach < group; reach *= base) {
+            ++digits;
+            tail_scale /= base;
+        }
+        // digits per table, a table holds at most 1024 entries. with groups
+        // up to max_group_size that is at most 4 tables.
+        unsigned table_digits = 1;
+        std::uint32_t table_size = base;
+        while (table_digits < digits && table_size * base <= 1024) {
+            ++table_digits;
+            table_size *= base;
+        }
+        unsigned tables = (digits + table_digits - 1) / table_digits;
+        std::array<double, 4 * 1024> table;
+        std::array<std::uint16_t, 1024> permutation;
+        std::array<std::uint32_t, 4> part{};
+
+        std::uint64_t current = ~std::uint64_t{0};
+        double tail = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            std::uint64_t index = first + i;
+            if (index >> group_bits != current) {
+                current = index >> group_bits;
+                std::uint64_t state = scramble_key(seed, current, dimension);
+                double scale = 1.0 / base;
+                for (unsigned t = 0; t < tables; ++t) {
+                    // grown one digit at a time, the new digit is the high one
+                    double *entries = table.data() + t * 1024;
+                    entries[0] = 0.0;
+                    std::uint32_t size = 1;
+                    for (unsigned k = t * table_digits; k < std::min(digits, (t + 1) * table_digits); ++k) {
+                        for (std::uint32_t d = 0; d < base; ++d) {
+                            permutation[d] = static_cast<std::uint16_t>(d);
+                        }
+                        for (std::uint32_t d = base - 1; d > 0; --d) {
+                            std::swap(permutation[d], permutation[splitmix64(state) % (d + 1)]);
+                        }
+                        for (std::uint32_t d = base - 1; d < base; --d) {
+                            for (std::uint32_t v = 0; v < size; ++v) {
+                                entries[d * size + v] = entries[v] + permutation[d] * scale;
+                            }
+                        }
+                        size *= base;
+                        scale /= base;
+                    }
+                }
+                tail = (to_unit_double(splitmix64(state)) + 0x1p-53) * tail_scale;
+                std::uint64_t j = index & (group - 1);
+                for (unsigned t = 0; t < tables; ++t, j /= table_size) {
+                    part[t] = static_cast<std::uint32_t>(j % table_size);
+                }
+            } else {
+                // odometer step in base table_size; the top table never
+                // carries out inside a group
+                for (unsigned t = 0; t < tables && ++part[t] == table_size; ++t) {
+                    part[t] = 0;
+                }
+            }
+            double x = tail;
+            for (unsigned t = 0; t < tables; ++t) {
+                x += table[t * 1024 + part[t]];
+            }
+            out[i] = std::min(x, 1.0 - 0x1p-53);
+        }
+    }
+};
+
+// folds per point values, in point order, into one mean per group and adds
+// the means to a running_stats. ranges have to start on a group boundary,
+// a group may be split over several add calls.
+class group_means {
+  public:
+    explicit group_means(size_t group_size) : size(group_size) {}
+
+    void add(const double *x, size_t n, running_stats &stats) {
+        if (size == 1) {
+            stats.add_block(x, n);
+            return;
+        }
+        double scale = 1.0 / static_cast<double>(size);
+        while (n > 0) {
+            size_t take = std::min(n, size - filled);
+            for (size_t i = 0; i < take; ++i) {
+                sum += x[i];
+            }
+            filled += take;
+            x += take;
+            n -= take;
+            if (filled == size) {
+                means[count++] = sum * scale;
+                sum = 0.0;
+                filled = 0;
+                if (count == means.size()) {
+                    flush(stats);
+                }
+            }
+        }
+        flush(stats);
+    }
+
+  private:
+    size_t size;
+    size_t filled{0};
+    double sum{0.0};
+    std::array<double, block_stream::block_size> means;
+    size_t count{0};
+
+    void flush(running_stats &stats) {
+        stats.add_block(means.data(), count);
+        count = 0;
+    }
+};
+
+// f - beta (c - mean) has the same expectation as f for any fixed beta, and
+// the least variance at beta = cov(f, c) / var(c), a 1 - corr(f, c)^2
+// reduction. beta is fitted on an independent pilot run, fitting it on the
+// samples themselves would bias the estimate. the default is no control.
+struct control_variate {
+    double mean{0.0};
+    double beta{0.0};
+
+    double apply(double f, double c) const { return f - beta * (c - mean); }
+};
+
+// least squares beta for pilot samples f and their controls c
+inline double control_beta(const double *f, const double *c, size_t n) {
+    double mean_f = 0.0, mean_c = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        mean_f += f[i];
+        mean_c += c[i];
+    }
+    mean_f /= static_cast<double>(n);
+    mean_c /= static_cast<double>(n);
+    double cov = 0.0, var = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        cov += (f[i] - mean_f) * (c[i] - mean_c);
+        var += (c[i] - mean_c) * (c[i] - mean_c);
+    }
+    return var > 0.0 ? cov / var : 0.0;
+}
+
+// stream id for pilot runs, no point set uses it
+constexpr std::uint64_t pilot_stream = ~std::uint64_t{0};
+
+// π observations [first, first + n) from a point set, each one is 4 times
+// the fraction of a group's points inside the quarter circle. under a
+// control each point is corrected by its x^2 + y^2.
+inline void sample_pi(const point_set &points, std::uint64_t first, std::uint64_t n,
+                      running_stats &stats, const control_variate &control = {}) {
+    constexpr size_t block = block_stream::block_size;
+    alignas(64) double x[block];
+    alignas(64) double y[block];
+    group_means groups(points.group_size());
+    std::uint64_t point = first * points.group_size();
+    std::uint64_t end = (first + n) * points.group_size();
+    while (point < end) {
+        size_t count = static_cast<size_t>(std::min<std::uint64_t>(end - point, block - point % block));
+        points.fill(0, point, count, x, y);
+        // the values overwrite x in place
+        for (size_t i = 0; i < count; ++i) {
+            double r2 = x[i] * x[i] + y[i] * y[i];
+            x[i] = control.apply(r2 <= 1.0 ? 4.0 : 0.0, r2);
+        }
+        groups.add(x, count, stats);
+        point += count;
+    }
+}
+
+// the control for sample_pi: x^2 + y^2 has mean 2/3, and beta is fitted on
+// `pilot` independent points
+inline control_variate pi_control(std::uint64_t seed, size_t pilot = 1 << 16) {
+    std::vector<double> f(pilot), c(pilot);
+    block_stream(seed, pilot_stream).fill(0, pilot, f.data(), c.data());
+    for (size_t i = 0; i < pilot; ++i) {
+        double r2 = f[i] * f[i] + c[i] * c[i];
+        f[i] = r2 <= 1.0 ? 4.0 : 0.0;
+        c[i] = r2;
+    }
+    return control_variate{2.0 / 3.0, control_beta(f.data(), c.data(), pilot)};
+}
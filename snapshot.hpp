@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "instrument.hpp"
+#include "mapped_file.hpp"
+#include "order_book.hpp"
+
+// state of an order book on disk: a fixed header followed by one fixed size
+// record per resting order. bids come first, then asks, each side best level
+// first and oldest order first inside a level, so levels, queue positions
+// and remaining quantities all follow from the record order. loading costs
+// one restore_order per live order, however many messages built the book.
+//
+// sequence is the number of feed messages the book had applied when it was
+// written. a restart maps the snapshot, restores it and replays the journal,
+// the messages from sequence on, on top.
+
+struct snapshot_order {
+    order_id_t order_id;
+    quantity_t quantity;
+    price_t price;
+    order_book::side side;
+    order_book::order_type order_type;
+};
+static_assert(sizeof(snapshot_order) == 24);
+
+struct snapshot_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t count;
+    std::uint64_t sequence;
+    double tick_size;
+    double lot_size;
+    price_t ladder_span;
+    // zero in files written before the instrument had a band
+    price_t price_band;
+};
+static_assert(sizeof(snapshot_header) == 48);
+
+constexpr char snapshot_magic[4] = {'Q', 'P', 'S', 'N'};
+constexpr std::uint32_t snapshot_version = 1;
+
+// the file is written next to path, synced and renamed over it, then the
+// directory is synced so the rename itself is durable. a crash at any point
+// leaves either the previous snapshot or the new one, never a torn file.
+inline void write_snapshot(const order_book &ob, const std::string &path,
+                           std::uint64_t sequence, size_t batch_size = 1 << 14) {
+    const std::string partial = path + ".partial";
+    std::FILE *file = std::fopen(partial.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("cannot create snapshot file " + partial);
+    }
+    const instrument &inst = ob.get_instrument();
+    snapshot_header header{};
+    std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+    header.version = snapshot_version;
+    header.count = ob.size();
+    header.sequence = sequence;
+    header.tick_size = inst.tick_size;
+    header.lot_size = inst.lot_size;
+    header.ladder_span = inst.ladder_span;
+    header.price_band = inst.price_band;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    std::vector<snapshot_order> batch;
+    batch.reserve(batch_size);
+    auto flush = [&]() {
+        ok = ok && std::fwrite(batch.data(), sizeof(snapshot_order), batch.size(), file) ==
+                       batch.size();
+        batch.clear();
+    };
+    ob.for_each_order([&](const order_book::order &o) {
+        batch.push_back(snapshot_order{o.get_id(), o.get_quantity(), o.get_price(),
+                                       o.get_side(), o.get_type()});
+        if (batch.size() == batch.capacity()) {
+            flush();
+        }
+    });
+    flush();
+    ok = ok && std::fflush(file) == 0 && ::fsync(fileno(file)) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(partial.c_str(), path.c_str()) != 0) {
+        std::remove(partial.c_str());
+        throw std::runtime_error("cannot write snapshot file " + path);
+    }
+    const size_t slash = path.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) {
+        throw std::runtime_error("cannot open snapshot directory " + dir);
+    }
+    ok = ::fsync(dir_fd) == 0;
+    ::close(dir_fd);
+    if (!ok) {
+        throw std::runtime_error("cannot sync snapshot directory " + dir);
+    }
+}
+
+// range checks for what a snapshot carries, the file is used in place so
+// any byte can be in any field. the ladder sizes go straight into the book's
+// price_ladder, a zero band is a file from before the instrument had one.
+inline bool valid(const snapshot_header &h) {
+    const price_t band = h.price_band != 0 ? h.price_band : instrument{}.price_band;
+    return h.ladder_span > 0 && band >= 2 * std::int64_t{h.ladder_span} + 1;
+}
+
+inline bool valid(const snapshot_order &r) {
+    return r.side <= order_book::side::sell &&
+           r.order_type <= order_book::order_type::immediate_or_cancel;
+}
+
+// read only mapping of a snapshot file, the records are restored straight
+// from the page cache
+class mapped_snapshot {
+  public:
+    explicit mapped_snapshot(const std::string &path)
+        : file(path, "snapshot", sizeof(snapshot_header)) {
+        const snapshot_header &h = header();
+        if (std::memcmp(h.magic, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+            h.version != snapshot_version ||
+            h.count > (file.size() - sizeof(snapshot_header)) / sizeof(snapshot_order) ||
+            !valid(h)) {
+            throw std::runtime_error("not a snapshot file " + path);
+        }
+    }
+
+    const snapshot_header &header() const {
+        return *reinterpret_cast<const snapshot_header *>(file.bytes());
+    }
+    instrument get_instrument() const {
+        instrument inst;
+        inst.tick_size = header().tick_size;
+        inst.lot_size = header().lot_size;
+        inst.ladder_span = header().ladder_span;
+        if (header().price_band != 0) {
+            inst.price_band = header().price_band;
+        }
+        return inst;
+    }
+    std::uint64_t sequence() const { return header().sequence; }
+
+    const snapshot_order *begin() const {
+        return reinterpret_cast<const snapshot_order *>(file.bytes() +
+                                                        sizeof(snapshot_header));
+    }
+    const snapshot_order *end() const { return begin() + header().count; }
+    size_t size() const { return header().count; }
+
+  private:
+    mapped_file file;
+};
+
+// rebuild an empty book from a snapshot. the book should be sized for at
+// least snap.size() orders so the restore does not grow the pool.
+inline void load_snapshot(order_book &ob, const mapped_snapshot &snap) {
+    if (ob.size() != 0) {
+        throw std::logic_error("load_snapshot into a book that has orders");
+    }
+    for (const snapshot_order &r : snap) {
+        if (!valid(r) || !ob.restore_order(order_book::order(r.order_id, r.order_type, r.side,
+                                                             r.price, r.quantity))) {
+            throw std::runtime_error("snapshot has an invalid or duplicate order");
+        }
+    }
+    auto bid = ob.best_bid();
+    auto ask = ob.best_ask();
+    if (bid && ask && *bid >= *ask) {
+        throw std::runtime_error("snapshot book is crossed");
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// bounded lock-free single producer / single consumer ring. each side keeps
+// a cached copy of the other side's index so the shared cache lines are only
+// read when the ring looks full (producer) or empty (consumer).
+template <class T> class spsc_ring {
+  public:
+    // capacity is rounded up to a power of two
+    explicit spsc_ring(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    spsc_ring(const spsc_ring &) = delete;
+    spsc_ring &operator=(const spsc_ring &) = delete;
+
+    // producer side, false when the ring is full
+    bool try_push(const T &value) {
+        size_t tail = tail_index.load(std::memory_order_relaxed);
+        if (tail - head_cache > mask) {
+            head_cache = head_index.load(std::memory_order_acquire);
+            if (tail - head_cache > mask) {
+                return false;
+            }
+        }
+        buffer[tail & mask] = value;
+        tail_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false when the ring is empty
+    bool try_pop(T &value) {
+        size_t head = head_index.load(std::memory_order_relaxed);
+        if (head == tail_cache) {
+            tail_cache = tail_index.load(std::memory_order_acquire);
+            if (head == tail_cache) {
+                return false;
+            }
+        }
+        value = buffer[head & mask];
+        head_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // total items ever pushed / popped, safe to read from any thread
+    size_t pushed() const { return tail_index.load(std::memory_order_acquire); }
+    size_t popped() const { return head_index.load(std::memory_order_acquire); }
+
+    size_t capacity() const { return mask + 1; }
+
+  private:
+    std::vector<T> buffer;
+    size_t mask{0};
+    // producer and consumer state on separate cache lines
+    alignas(64) std::atomic<size_t> tail_index{0};
+    size_t head_cache{0};
+    alignas(64) std::atomic<size_t> head_index{0};
+    size_t tail_cache{0};
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// move only, type erased void() callable for the thread pool. callables up
+// to inline_size bytes (a lambda with a few captures, a packaged_task) are
+// stored inside the task itself, so building and queueing one does not touch
+// the heap. bigger callables fall back to a heap allocation.
+class task {
+  public:
+    static constexpr size_t inline_size = 48;
+
+    task() = default;
+
+    template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, task>>>
+    task(F &&f) {
+        using fn_t = std::decay_t<F>;
+        if constexpr (fits_inline<fn_t>()) {
+            ::new (static_cast<void *>(storage)) fn_t(std::forward<F>(f));
+            table = &inline_ops<fn_t>;
+        } else {
+            ::new (static_cast<void *>(storage)) fn_t *(new fn_t(std::forward<F>(f)));
+            table = &heap_ops<fn_t>;
+        }
+    }
+
+    task(task &&other) noexcept { take(other); }
+
+    task &operator=(task &&other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+
+    ~task() { reset(); }
+
+    explicit operator bool() const { return table != nullptr; }
+
+    void operator()() { table->invoke(storage); }
+
+    void reset() {
+        if (table) {
+            table->destroy(storage);
+            table = nullptr;
+        }
+    }
+
+#ifdef QUANT_INSTRUMENTATION
+    // latency_clock ticks when the task was queued, set by the pool
+    std::uint64_t queued_at{0};
+#endif
+
+  private:
+    struct ops {
+        void (*invoke)(void *);
+        // move constructs into dst and destroys src
+        void (*relocate)(void *dst, void *src);
+        void (*destroy)(void *);
+    };
+
+    template <class fn_t> static constexpr bool fits_inline() {
+        return sizeof(fn_t) <= inline_size &&
+               alignof(fn_t) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible_v<fn_t>;
+    }
+
+    template <class fn_t>
+    static constexpr ops inline_ops{
+        [](void *p) { (*static_cast<fn_t *>(p))(); },
+        [](void *dst, void *src) {
+            ::new (dst) fn_t(std::move(*static_cast<fn_t *>(src)));
+            static_cast<fn_t *>(src)->~fn_t();
+        },
+        [](void *p) { static_cast<fn_t *>(p)->~fn_t(); },
+    };
+
+    template <class fn_t>
+    static constexpr ops heap_ops{
+        [](void *p) { (**static_cast<fn_t **>(p))(); },
+        [](void *dst, void *src) {
+            ::new (dst) fn_t *(*static_cast<fn_t **>(src));
+        },
+        [](void *p) { delete *static_cast<fn_t **>(p); },
+    };
+
+    alignas(std::max_align_t) unsigned char storage[inline_size];
+    const ops *table{nullptr};
+
+    void take(task &other) {
+        if (other.table) {
+            other.table->relocate(storage, other.storage);
+            table = other.table;
+            other.table = nullptr;
+        }
+#ifdef QUANT_INSTRUMENTATION
+        queued_at = other.queued_at;
+#endif
+    }
+};
+
+// growable ring of tasks usable as a queue or a deque. capacity doubles when
+// full and is never given back, so once a pool has seen its peak backlog
+// pushing and popping no longer allocates.
+class task_deque {
+  public:
+    // capacity is rounded up to a power of two
+    explicit task_deque(size_t capacity = 1024) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots = std::make_unique<task[]>(size);
+        mask = size - 1;
+    }
+
+    bool empty() const { return head == tail; }
+    size_t size() const { return tail - head; }
+
+    void push_back(task &&t) {
+        if (size() == mask + 1) {
+            grow();
+        }
+        slots[tail & mask] = std::move(t);
+        ++tail;
+    }
+
+    task pop_front() {
+        task t = std::move(slots[head & mask]);
+        ++head;
+        return t;
+    }
+
+    task pop_back() {
+        --tail;
+        return std::move(slots[tail & mask]);
+    }
+
+  private:
+    std::unique_ptr<task[]> slots;
+    size_t mask{0};
+    size_t head{0};
+    size_t tail{0};
+
+    void grow() {
+        size_t size = (mask + 1) * 2;
+        auto bigger = std::make_unique<task[]>(size);
+        for (size_t i = head; i != tail; ++i) {
+            bigger[i & (size - 1)] = std::move(slots[i & mask]);
+        }
+        slots = std::move(bigger);
+        mask = size - 1;
+    }
+};
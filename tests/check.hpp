@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+// minimal checks for the test executables: a failed CHECK is reported with
+// its location and the test keeps going, main returns check_result()
+inline int &check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                                        \
+    do {                                                                                   \
+        if (!(cond)) {                                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n";    \
+            ++check_failures();                                                            \
+        }                                                                                  \
+    } while (0)
+
+inline int check_result() {
+    if (check_failures() != 0) {
+        std::cerr << check_failures() << " check(s) failed\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+// monte carlo results must not depend on the pool: the same seed and sample
+// count give the same bits on any number of threads and either scheduling
+#include "monte_carlo.hpp"
+#include "option_pricing.hpp"
+#include "rng.hpp"
+#include "sampling.hpp"
+#include "tests/check.hpp"
+#include "thread_pool.hpp"
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+static bool same_bits(const running_stats &a, const running_stats &b) {
+    return a.count == b.count && std::bit_cast<std::uint64_t>(a.mean) == std::bit_cast<std::uint64_t>(b.mean) &&
+           std::bit_cast<std::uint64_t>(a.m2) == std::bit_cast<std::uint64_t>(b.m2);
+}
+
+// every pool the results are compared across
+template <class F> static void for_each_pool(F &&f) {
+    for (auto mode : {thread_pool::scheduling::shared_queue, thread_pool::scheduling::work_stealing}) {
+        for (size_t threads : {1, 2, 3, 4, 8}) {
+            thread_pool pool(threads, mode);
+            f(pool);
+        }
+    }
+}
+
+// a sum whose rounding depends on the order of the terms
+static void ordered_reduce() {
+    std::vector<double> sums;
+    for_each_pool([&](thread_pool &pool) {
+        sums.push_back(pool.parallel_reduce_ordered(
+            size_t{0}, size_t{100000}, 0.0,
+            [](size_t begin, size_t end, double &acc) {
+                for (size_t i = begin; i < end; ++i) {
+                    acc += 1.0 / static_cast<double>(i * i + 1);
+                }
+            },
+            [](double a, double b) { return a + b; }, 777));
+    });
+    for (double s : sums) {
+        CHECK(std::bit_cast<std::uint64_t>(s) == std::bit_cast<std::uint64_t>(sums[0]));
+    }
+}
+
+static void pi_until(double tolerance) {
+    block_stream stream(42, 0);
+    convergence_options options;
+    options.tolerance = tolerance;
+    options.batch_size = 1 << 14;
+    options.round_size = 1 << 18;
+    options.min_samples = 1 << 18;
+    options.max_samples = 1 << 22;
+    std::vector<convergence_result> results;
+    for_each_pool([&](thread_pool &pool) {
+        results.push_back(run_until_converged(
+            pool,
+            [&stream](std::uint64_t first, std::uint64_t n, running_stats &stats) {
+                sample_pi(stream, first, n, stats);
+            },
+            options));
+    });
+    for (const convergence_result &r : results) {
+        CHECK(r.reason == results[0].reason);
+        CHECK(same_bits(r.stats, results[0].stats));
+    }
+}
+
+static bool same_bits(const greeks &a, const greeks &b) {
+    return same_bits(a.price, b.price) && same_bits(a.delta, b.delta) &&
+           same_bits(a.gamma, b.gamma) && same_bits(a.vega, b.vega);
+}
+
+// prices and greeks of an option under every sampling mode
+static void option_greeks() {
+    gbm_model model;
+    time_grid grid{1.0, 12};
+    european_payoff call{option_kind::call, 100.0};
+    barrier_payoff out{option_kind::call, 100.0, barrier_kind::up_and_out, 130.0};
+    const std::uint64_t paths = 100000;
+    for (auto mode : {sampling_mode::pseudo, sampling_mode::antithetic, sampling_mode::stratified,
+                      sampling_mode::sobol, sampling_mode::halton}) {
+        point_set points(mode, 7);
+        std::vector<running_stats> prices;
+        std::vector<greeks> pathwise, bumped;
+        for_each_pool([&](thread_pool &pool) {
+            prices.push_back(price(pool, model, grid, call, paths, points));
+            pathwise.push_back(pathwise_greeks(pool, model, grid, call, paths, points));
+            bumped.push_back(bump_greeks(pool, model, grid, out, paths, points));
+        });
+        for (size_t i = 0; i < prices.size(); ++i) {
+            CHECK(same_bits(prices[i], prices[0]));
+            CHECK(same_bits(pathwise[i], pathwise[0]));
+            CHECK(same_bits(bumped[i], bumped[0]));
+        }
+    }
+}
+
+int main() {
+    ordered_reduce();
+    // runs to the sample cap, and one that stops on tolerance part way
+    pi_until(0.0);
+    pi_until(3e-3);
+    option_greeks();
+    return check_result();
+}
@@ -0,0 +1,132 @@
+// latency_histogram: bucket resolution over the whole 64 bit range, the
+// rank behind each percentile, merging and the summary in nanoseconds
+#include "latency.hpp"
+#include "tests/check.hpp"
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+// histograms are 15 KB, keep them off the stack
+static std::unique_ptr<latency_histogram> histogram() {
+    return std::make_unique<latency_histogram>();
+}
+
+static bool near(std::uint64_t reported, std::uint64_t exact) {
+    return reported >= exact && reported - exact <= exact / 32;
+}
+
+// a value is reported as the top of its bucket: never below it and at most
+// 1/32 above, exact below 32
+static void resolution() {
+    constexpr std::uint64_t top = std::numeric_limits<std::uint64_t>::max();
+    std::vector<std::uint64_t> values;
+    for (std::uint64_t v = 0; v < 300; ++v) {
+        values.push_back(v);
+    }
+    for (unsigned bit = 5; bit < 64; ++bit) {
+        std::uint64_t p = std::uint64_t{1} << bit;
+        for (std::uint64_t v : {p - 1, p, p + 1, p + p / 3, p + p / 2}) {
+            values.push_back(v);
+        }
+    }
+    std::mt19937_64 gen(1);
+    for (int i = 0; i < 10000; ++i) {
+        values.push_back(gen() >> (gen() % 64));
+    }
+    values.push_back(top);
+    bool within = true, exact_small = true;
+    for (std::uint64_t v : values) {
+        auto h = histogram();
+        h->record(v);
+        h->record(top);
+        std::uint64_t reported = h->percentile(0.0);
+        within = within && near(reported, v);
+        exact_small = exact_small && (v >= 32 || reported == v);
+    }
+    CHECK(within);
+    CHECK(exact_small);
+}
+
+// percentile(q) is the sample of rank floor(q (n - 1)) + 1, up to the
+// bucket width, never above the largest sample
+static void percentiles() {
+    auto h = histogram();
+    CHECK(h->count() == 0);
+    CHECK(h->percentile(0.5) == 0);
+    for (std::uint64_t v = 1; v <= 1000; ++v) {
+        h->record(v);
+    }
+    CHECK(h->count() == 1000);
+    CHECK(h->max() == 1000);
+    CHECK(h->percentile(0.0) == 1);
+    CHECK(near(h->percentile(0.5), 500));
+    CHECK(near(h->percentile(0.9), 900));
+    CHECK(near(h->percentile(0.99), 990));
+    CHECK(h->percentile(1.0) == 1000);
+    // out of range quantiles are clamped
+    CHECK(h->percentile(-1.0) == 1);
+    CHECK(h->percentile(2.0) == 1000);
+    bool monotone = true;
+    for (double q = 0.0; q < 1.0; q += 0.001) {
+        monotone = monotone && h->percentile(q) <= h->percentile(q + 0.001);
+    }
+    CHECK(monotone);
+
+    // a long tail only moves the high percentiles
+    auto tail = histogram();
+    for (int i = 0; i < 999; ++i) {
+        tail->record(100);
+    }
+    tail->record(1000000);
+    CHECK(near(tail->percentile(0.5), 100));
+    CHECK(near(tail->percentile(0.998), 100));
+    CHECK(near(tail->percentile(0.999), 100));
+    CHECK(tail->percentile(1.0) == 1000000);
+}
+
+// merged histograms answer like one histogram that saw every sample
+static void merge_and_reset() {
+    auto a = histogram(), b = histogram(), all = histogram();
+    std::mt19937_64 gen(2);
+    for (int i = 0; i < 20000; ++i) {
+        std::uint64_t v = gen() % 100000;
+        (i % 3 ? a : b)->record(v);
+        all->record(v);
+    }
+    a->merge(*b);
+    CHECK(a->count() == all->count());
+    CHECK(a->max() == all->max());
+    bool same = true;
+    for (double q : {0.0, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+        same = same && a->percentile(q) == all->percentile(q);
+    }
+    CHECK(same);
+
+    a->reset();
+    CHECK(a->count() == 0 && a->max() == 0 && a->percentile(0.99) == 0);
+    a->record(7);
+    CHECK(a->percentile(0.5) == 7);
+}
+
+static void summary_in_nanoseconds() {
+    auto h = histogram();
+    for (std::uint64_t v = 1; v <= 20; ++v) {
+        h->record(v);
+    }
+    latency_summary s = summarize(*h, 2.5);
+    CHECK(s.count == 20);
+    CHECK(s.p50 == 2.5 * static_cast<double>(h->percentile(0.5)));
+    // rank floor(0.99 * 19) + 1 = 19, exact below 32
+    CHECK(s.p99 == 2.5 * 19);
+    CHECK(s.max == 50.0);
+}
+
+int main() {
+    resolution();
+    percentiles();
+    merge_and_reset();
+    summary_in_nanoseconds();
+    return check_result();
+}
@@ -0,0 +1,98 @@
+// matching_engine: symbols spread over shards end up in the state a serial
+// replay of their own messages gives, and bad arguments are refused on the
+// caller's thread
+#include "matching_engine.hpp"
+#include "tests/check.hpp"
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using resting_t = std::tuple<order_id_t, quantity_t, price_t>;
+
+static std::vector<resting_t> resting(const order_book &ob) {
+    std::vector<resting_t> out;
+    ob.for_each_order([&](const order_book::order &o) {
+        out.emplace_back(o.get_id(), o.get_quantity(), o.get_price());
+    });
+    return out;
+}
+
+// two producers, each owning half the symbols, submit interleaved flow.
+// per symbol the order of messages is kept, so every book must match a
+// serial replay of that symbol's feed.
+static void shards_match_serial_replay() {
+    const instrument inst{};
+    constexpr size_t symbols = 7;
+    constexpr size_t per_symbol = 20000;
+    std::vector<std::vector<message>> feeds(symbols);
+    for (size_t s = 0; s < symbols; ++s) {
+        feed_generator gen(100 + s, inst.to_ticks(100.0));
+        for (size_t i = 0; i < per_symbol; ++i) {
+            feeds[s].push_back(gen.next());
+        }
+    }
+
+    matching_engine engine(3, 1 << 10);
+    for (size_t s = 0; s < symbols; ++s) {
+        CHECK(engine.add_symbol(inst) == s);
+    }
+    engine.start();
+    auto produce = [&](size_t first) {
+        for (size_t i = 0; i < per_symbol; ++i) {
+            for (size_t s = first; s < symbols; s += 2) {
+                engine.submit(static_cast<symbol_id>(s), feeds[s][i]);
+            }
+        }
+    };
+    std::thread a(produce, 0), b(produce, 1);
+    a.join();
+    b.join();
+    engine.wait_until_idle();
+    engine.stop();
+
+    for (size_t s = 0; s < symbols; ++s) {
+        order_book serial(inst);
+        for (const message &m : feeds[s]) {
+            apply(serial, m);
+        }
+        CHECK(resting(engine.book(static_cast<symbol_id>(s))) == resting(serial));
+    }
+}
+
+static void bad_arguments() {
+    bool threw = false;
+    try {
+        matching_engine engine(0);
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    matching_engine engine(2);
+    engine.add_symbol(instrument{});
+    engine.start();
+    const message m{1, 5, 100, message_type::add, order_book::side::buy,
+                    order_book::order_type::limit};
+    auto refused = [](auto &&call) {
+        try {
+            call();
+        } catch (const std::out_of_range &) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(refused([&]() { engine.try_submit(1, m); }));
+    CHECK(refused([&]() { engine.submit(7, m); }));
+    CHECK(engine.try_submit(0, m));
+    engine.wait_until_idle();
+    engine.stop();
+    CHECK(refused([&]() { engine.book(1); }));
+    CHECK(engine.book(0).size() == 1);
+}
+
+int main() {
+    shards_match_serial_replay();
+    bad_arguments();
+    return check_result();
+}
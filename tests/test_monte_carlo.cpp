@@ -0,0 +1,121 @@
+// monte carlo: the SIMD hit count agrees with a plain loop on the same
+// points, and run_until_converged refuses settings it cannot finish with
+// and batches that do not add the samples they were asked for
+#include "monte_carlo.hpp"
+#include "tests/check.hpp"
+#include "thread_pool.hpp"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+template <class E, class F> static bool throws(F &&f) {
+    try {
+        f();
+    } catch (const E &) {
+        return true;
+    }
+    return false;
+}
+
+// the kernel count_in_circle is checked against, one point at a time
+static std::uint64_t scalar_count(const double *x, const double *y, size_t n) {
+    std::uint64_t hits = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = x[i] * x[i];
+        d += y[i] * y[i];
+        hits += d <= 1.0;
+    }
+    return hits;
+}
+
+// every length and start offset around the vector width, so the SIMD body,
+// its tail and unaligned loads all run, on random points and on points
+// that sit exactly on or just past the circle
+static void simd_matches_scalar() {
+    std::mt19937_64 gen(5);
+    std::uniform_real_distribution<double> u(0.0, 1.2);
+    std::vector<double> x(4096), y(4096);
+    for (size_t i = 0; i < x.size(); ++i) {
+        x[i] = u(gen);
+        y[i] = u(gen);
+    }
+    const double above = std::nextafter(1.0, 2.0);
+    const double edges[][2] = {{1.0, 0.0}, {0.0, 1.0}, {above, 0.0}, {0.0, above},
+                               {0.75, 0.625}, {0.0, 0.0}, {-1.0, 0.0},
+                               {std::numeric_limits<double>::quiet_NaN(), 0.0}};
+    for (size_t i = 0; i < 64; ++i) {
+        x[4 + i] = edges[i % 8][0];
+        y[4 + i] = edges[(i / 8 + i) % 8][1];
+    }
+    for (size_t offset = 0; offset < 9; ++offset) {
+        for (size_t n = 0; n <= 70; ++n) {
+            CHECK(count_in_circle(x.data() + offset, y.data() + offset, n) ==
+                  scalar_count(x.data() + offset, y.data() + offset, n));
+        }
+    }
+    for (size_t offset : {0, 1, 3, 96}) {
+        size_t n = x.size() - offset;
+        CHECK(count_in_circle(x.data() + offset, y.data() + offset, n) ==
+              scalar_count(x.data() + offset, y.data() + offset, n));
+    }
+    // points on the circle count, points past it or NaN do not
+    CHECK(count_in_circle(&edges[0][0], &edges[0][1], 1) == 1);
+    std::vector<double> ex, ey;
+    for (const auto &e : edges) {
+        ex.push_back(e[0]);
+        ey.push_back(e[1]);
+    }
+    CHECK(count_in_circle(ex.data(), ey.data(), ex.size()) == 5);
+}
+
+static void convergence_arguments(thread_pool &pool) {
+    block_stream stream(42, 0);
+    auto pi = [&stream](std::uint64_t first, std::uint64_t n, running_stats &stats) {
+        sample_pi(stream, first, n, stats);
+    };
+    convergence_options options;
+    options.batch_size = 1 << 10;
+    options.round_size = 1 << 12;
+    options.min_samples = 1 << 12;
+    options.max_samples = 1 << 14;
+    options.tolerance = 0.0;
+    auto run = [&](const convergence_options &o) { return run_until_converged(pool, pi, o); };
+
+    convergence_result r = run(options);
+    CHECK(r.reason == stop_reason::max_samples);
+    CHECK(r.stats.count == options.max_samples);
+
+    convergence_options bad = options;
+    bad.round_size = 0;
+    CHECK(throws<std::invalid_argument>([&]() { run(bad); }));
+    bad = options;
+    bad.min_samples = bad.max_samples + 1;
+    CHECK(throws<std::invalid_argument>([&]() { run(bad); }));
+    bad = options;
+    bad.min_samples = 0;
+    bad.max_samples = 0;
+    CHECK(throws<std::invalid_argument>([&]() { run(bad); }));
+
+    // a cap that is not a multiple of the round size still stops on it
+    convergence_options ragged = options;
+    ragged.max_samples = options.round_size * 2 + 123;
+    ragged.min_samples = 1;
+    r = run(ragged);
+    CHECK(r.stats.count == ragged.max_samples);
+
+    // a batch that drops samples would otherwise run past the cap
+    auto short_batch = [&stream](std::uint64_t first, std::uint64_t n, running_stats &stats) {
+        sample_pi(stream, first, n > 1 ? n - 1 : n, stats);
+    };
+    CHECK(throws<std::logic_error>([&]() { run_until_converged(pool, short_batch, options); }));
+}
+
+int main() {
+    simd_matches_scalar();
+    thread_pool pool(4);
+    convergence_arguments(pool);
+    return check_result();
+}
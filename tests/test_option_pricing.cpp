@@ -0,0 +1,98 @@
+// option pricing against the closed form: the simulated price and the
+// pathwise and bumped greeks of a european option agree with Black-Scholes
+// within a few standard errors
+#include "option_pricing.hpp"
+#include "sampling.hpp"
+#include "tests/check.hpp"
+#include "thread_pool.hpp"
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+
+// closed form delta, gamma and vega of a european option
+struct closed_form {
+    double price, delta, gamma, vega;
+};
+
+static closed_form black_scholes_greeks(const gbm_model &m, double maturity, option_kind kind,
+                                        double strike) {
+    double sd = m.volatility * std::sqrt(maturity);
+    double d1 = (std::log(m.spot / strike) +
+                 (m.rate - m.dividend + 0.5 * m.volatility * m.volatility) * maturity) /
+                sd;
+    double carry = std::exp(-m.dividend * maturity);
+    double density = std::exp(-0.5 * d1 * d1) / std::sqrt(2.0 * std::numbers::pi);
+    double n_d1 = 0.5 * std::erfc(-d1 / std::sqrt(2.0));
+    return {black_scholes(m, maturity, kind, strike),
+            carry * (kind == option_kind::call ? n_d1 : n_d1 - 1.0),
+            carry * density / (m.spot * sd), m.spot * carry * density * std::sqrt(maturity)};
+}
+
+// the estimate is within z standard errors of the exact value, plus a
+// little room for the bias of a finite difference
+static bool near(const running_stats &estimate, double exact, double slack = 0.0,
+                 double z = 4.0) {
+    return std::abs(estimate.mean - exact) <= z * estimate.std_error() + slack;
+}
+
+static void against_black_scholes(thread_pool &pool) {
+    gbm_model model{100.0, 0.03, 0.01, 0.25};
+    time_grid grid{1.0, 12};
+    const std::uint64_t paths = 400000;
+    for (option_kind kind : {option_kind::call, option_kind::put}) {
+        for (double strike : {90.0, 100.0, 115.0}) {
+            european_payoff payoff{kind, strike};
+            closed_form exact = black_scholes_greeks(model, grid.maturity, kind, strike);
+            point_set points(sampling_mode::pseudo, 11);
+
+            running_stats p = price(pool, model, grid, payoff, paths, points);
+            CHECK(near(p, exact.price));
+
+            greeks pathwise = pathwise_greeks(pool, model, grid, payoff, paths, points);
+            CHECK(near(pathwise.price, exact.price));
+            CHECK(near(pathwise.delta, exact.delta));
+            CHECK(near(pathwise.vega, exact.vega));
+
+            greeks bumped = bump_greeks(pool, model, grid, payoff, paths, points);
+            CHECK(near(bumped.price, exact.price));
+            CHECK(near(bumped.delta, exact.delta, 1e-4));
+            CHECK(near(bumped.gamma, exact.gamma, 1e-4));
+            CHECK(near(bumped.vega, exact.vega, 1e-3));
+        }
+    }
+}
+
+// a vol bump at or above the volatility would price the down leg with zero
+// or negative vol
+static void bump_sizes(thread_pool &pool) {
+    time_grid grid{1.0, 4};
+    european_payoff call{option_kind::call, 100.0};
+    point_set points(sampling_mode::pseudo, 3);
+    auto rejected = [&](const gbm_model &m, double spot_bump, double vol_bump) {
+        try {
+            bump_greeks(pool, m, grid, call, 1024, points, spot_bump, vol_bump);
+        } catch (const std::invalid_argument &) {
+            return true;
+        }
+        return false;
+    };
+    gbm_model low_vol{100.0, 0.0, 0.0, 0.01};
+    CHECK(rejected(low_vol, 0.01, 0.01));
+    CHECK(rejected(low_vol, 0.01, 0.02));
+    CHECK(!rejected(low_vol, 0.01, 0.001));
+    gbm_model model;
+    CHECK(rejected(model, 0.0, 0.01));
+    CHECK(rejected(model, 1.0, 0.01));
+    CHECK(rejected(model, 0.01, 0.0));
+    CHECK(rejected(model, 0.01, std::nan("")));
+
+    greeks g = bump_greeks(pool, low_vol, grid, call, 4096, points, 0.01, 0.001);
+    CHECK(std::isfinite(g.vega.mean));
+}
+
+int main() {
+    thread_pool pool(4);
+    against_black_scholes(pool);
+    bump_sizes(pool);
+    return check_result();
+}
@@ -0,0 +1,350 @@
+// order_book: price-time priority, cancel / reduce / modify, the order types
+// that never rest, rejects, the aggregated views of the book and its L2
+// depth stream
+#include "order_book.hpp"
+#include "tests/check.hpp"
+#include <map>
+#include <utility>
+#include <vector>
+
+using side = order_book::side;
+using order_type = order_book::order_type;
+
+// keeps every event the book publishes, in order
+struct recorder : event_sink {
+    std::vector<event> events;
+    void publish(const event &e) override { events.push_back(e); }
+
+    std::vector<event> of(event_type type) const {
+        std::vector<event> out;
+        for (const event &e : events) {
+            if (e.type == type) {
+                out.push_back(e);
+            }
+        }
+        return out;
+    }
+};
+
+static order_book::order limit(order_id_t id, side s, price_t price, quantity_t quantity) {
+    return order_book::order(id, order_type::limit, s, price, quantity);
+}
+
+// resting orders of the book in for_each_order order, as (id, quantity)
+static std::vector<std::pair<order_id_t, quantity_t>> resting(const order_book &ob) {
+    std::vector<std::pair<order_id_t, quantity_t>> out;
+    ob.for_each_order([&](const order_book::order &o) {
+        out.emplace_back(o.get_id(), o.get_quantity());
+    });
+    return out;
+}
+
+// better prices trade first, inside a level the oldest order does, and every
+// fill is at the resting order's price
+static void price_time_priority() {
+    order_book ob;
+    recorder rec;
+    ob.set_event_sink(&rec);
+    ob.add_order(limit(1, side::sell, 102, 5));
+    ob.add_order(limit(2, side::sell, 101, 5));
+    ob.add_order(limit(3, side::sell, 101, 5));
+    ob.add_order(limit(4, side::sell, 103, 5));
+    CHECK(ob.best_ask() == 101);
+    CHECK(!ob.best_bid());
+
+    ob.add_order(limit(10, side::buy, 102, 12));
+    auto fills = rec.of(event_type::fill);
+    CHECK(fills.size() == 3);
+    if (fills.size() == 3) {
+        CHECK(fills[0].match_id == 2 && fills[0].price == 101 && fills[0].quantity == 5);
+        CHECK(fills[1].match_id == 3 && fills[1].price == 101 && fills[1].quantity == 5);
+        CHECK(fills[2].match_id == 1 && fills[2].price == 102 && fills[2].quantity == 2);
+        CHECK(fills[0].order_id == 10);
+    }
+    // the buy is done, order 1 keeps its remainder at the front of 102
+    CHECK(ob.size() == 2);
+    CHECK(ob.best_ask() == 102);
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{1, 3}, {4, 5}}));
+
+    // a limit that does not cross rests, its remainder after a partial fill too
+    ob.add_order(limit(11, side::buy, 100, 4));
+    ob.add_order(limit(12, side::buy, 102, 10));
+    CHECK(ob.best_bid() == 102);
+    CHECK(ob.best_ask() == 103);
+    CHECK((resting(ob) ==
+           std::vector<std::pair<order_id_t, quantity_t>>{{12, 7}, {11, 4}, {4, 5}}));
+}
+
+static void cancel_reduce_modify() {
+    order_book ob;
+    recorder rec;
+    ob.set_event_sink(&rec);
+    ob.add_order(limit(1, side::buy, 100, 5));
+    ob.add_order(limit(2, side::buy, 100, 5));
+    ob.add_order(limit(3, side::buy, 99, 5));
+
+    CHECK(ob.cancel_order(3));
+    CHECK(!ob.cancel_order(3));
+    CHECK(rec.events.back().reason == reject_reason::unknown_order);
+    CHECK(ob.size() == 2);
+
+    // a reduction keeps the queue position
+    CHECK(ob.reduce_order(1, 2));
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{1, 2}, {2, 5}}));
+    CHECK(!ob.reduce_order(1, 3));
+    CHECK(rec.events.back().reason == reject_reason::invalid_quantity);
+
+    // so does a modify that only lowers the size at the same price
+    CHECK(ob.modify_order(1, 100, 1));
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{1, 1}, {2, 5}}));
+
+    // a size increase goes to the back of the level
+    CHECK(ob.modify_order(1, 100, 4));
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{2, 5}, {1, 4}}));
+
+    // a price change moves the order to its new level
+    CHECK(ob.modify_order(2, 101, 5));
+    CHECK(ob.best_bid() == 101);
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{2, 5}, {1, 4}}));
+
+    // a replacement can trade on entry
+    ob.add_order(limit(5, side::sell, 103, 3));
+    CHECK(ob.replace_order(1, limit(1, side::buy, 103, 4)));
+    CHECK(ob.best_bid() == 103);
+    CHECK(!ob.best_ask());
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{1, 1}, {2, 5}}));
+
+    // reducing to zero cancels
+    CHECK(ob.reduce_order(1, 0));
+    CHECK(ob.size() == 1);
+    CHECK(ob.best_bid() == 101);
+    CHECK(!ob.modify_order(42, 100, 1));
+}
+
+// a modify or replace the replacement would be rejected for fails and the
+// original keeps resting where it was
+static void rejected_replacement() {
+    instrument inst;
+    inst.ladder_span = 16;
+    inst.price_band = 64;
+    order_book ob(inst, 64);
+    recorder rec;
+    ob.set_event_sink(&rec);
+    ob.add_order(limit(1, side::buy, 1000, 5));
+    ob.add_order(limit(2, side::buy, 1000, 5));
+    ob.add_order(limit(3, side::buy, 999, 5));
+    const auto before = resting(ob);
+    rec.events.clear();
+
+    CHECK(!ob.modify_order(1, 998, 0));
+    CHECK(rec.events.back().reason == reject_reason::invalid_quantity);
+    CHECK(!ob.modify_order(1, 1000, -1));
+    CHECK(!ob.modify_order(1, 1100, 5));
+    CHECK(rec.events.back().reason == reject_reason::price_out_of_band);
+    CHECK(!ob.replace_order(1, limit(3, side::buy, 1001, 5)));
+    CHECK(rec.events.back().reason == reject_reason::duplicate_id);
+    CHECK(!ob.replace_order(1, limit(1, side::sell, 1001, 5)));
+    CHECK(rec.events.back().reason == reject_reason::side_mismatch);
+    CHECK(rec.of(event_type::cancel).empty());
+    CHECK(resting(ob) == before);
+    CHECK(ob.best_bid() == 1000);
+
+    // a new id that is free is fine
+    CHECK(ob.replace_order(1, limit(4, side::buy, 1001, 5)));
+    CHECK((resting(ob) ==
+           std::vector<std::pair<order_id_t, quantity_t>>{{4, 5}, {2, 5}, {3, 5}}));
+}
+
+// market and immediate or cancel never rest, fill or kill fills in full or
+// leaves the book untouched
+static void non_resting_types() {
+    order_book ob;
+    recorder rec;
+    ob.set_event_sink(&rec);
+    ob.add_order(limit(1, side::sell, 101, 5));
+    ob.add_order(limit(2, side::sell, 102, 5));
+    ob.add_order(limit(3, side::sell, 105, 5));
+
+    // short of depth within its limit: canceled, nothing traded
+    ob.add_order(order_book::order(10, order_type::for_or_kill_limit, side::buy, 102, 11));
+    CHECK(rec.of(event_type::fill).empty());
+    CHECK(rec.events.back().type == event_type::cancel && rec.events.back().order_id == 10);
+    CHECK(ob.size() == 3);
+
+    // enough depth: fills completely across both levels
+    ob.add_order(order_book::order(11, order_type::for_or_kill_limit, side::buy, 102, 7));
+    CHECK(rec.of(event_type::fill).size() == 2);
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{2, 3}, {3, 5}}));
+
+    // immediate or cancel takes what crosses, the rest is canceled
+    rec.events.clear();
+    ob.add_order(order_book::order(12, order_type::immediate_or_cancel, side::buy, 102, 10));
+    CHECK(rec.of(event_type::fill).size() == 1);
+    CHECK(rec.events.back().type == event_type::cancel && rec.events.back().quantity == 7);
+    CHECK(!ob.best_bid());
+    CHECK(ob.best_ask() == 105);
+
+    // a market order sweeps whatever price, its remainder never rests
+    rec.events.clear();
+    ob.add_order(limit(4, side::sell, 110, 5));
+    ob.add_order(order_book::order(13, order_type::market, side::buy, 0, 12));
+    auto fills = rec.of(event_type::fill);
+    CHECK(fills.size() == 2);
+    if (fills.size() == 2) {
+        CHECK(fills[0].price == 105 && fills[1].price == 110);
+    }
+    CHECK(rec.events.back().type == event_type::cancel && rec.events.back().quantity == 2);
+    CHECK(ob.size() == 0);
+    CHECK(!ob.best_bid() && !ob.best_ask());
+
+    // into an empty book
+    rec.events.clear();
+    ob.add_order(order_book::order(14, order_type::market, side::sell, 0, 3));
+    CHECK(rec.of(event_type::fill).empty());
+    CHECK(ob.size() == 0);
+}
+
+static void rejects() {
+    instrument inst;
+    inst.ladder_span = 16;
+    inst.price_band = 64;
+    order_book ob(inst, 64);
+    recorder rec;
+    ob.set_event_sink(&rec);
+
+    ob.add_order(limit(1, side::buy, 1000, 5));
+    ob.add_order(limit(1, side::buy, 999, 5));
+    CHECK(rec.events.back().type == event_type::reject);
+    CHECK(rec.events.back().reason == reject_reason::duplicate_id);
+    CHECK(ob.size() == 1);
+    CHECK((resting(ob) == std::vector<std::pair<order_id_t, quantity_t>>{{1, 5}}));
+
+    ob.add_order(limit(2, side::buy, 1000, 0));
+    CHECK(rec.events.back().reason == reject_reason::invalid_quantity);
+    ob.add_order(limit(3, side::buy, 1000, -4));
+    CHECK(rec.events.back().reason == reject_reason::invalid_quantity);
+
+    // the bid window may stretch to 64 ticks, not further
+    ob.add_order(limit(4, side::buy, 1030, 1));
+    CHECK(ob.best_bid() == 1030);
+    ob.add_order(limit(5, side::buy, 1100, 1));
+    CHECK(rec.events.back().reason == reject_reason::price_out_of_band);
+    CHECK(ob.size() == 2);
+
+    // a filled id is free again
+    ob.add_order(limit(6, side::sell, 1030, 1));
+    ob.add_order(limit(4, side::buy, 1001, 1));
+    CHECK(rec.events.back().type == event_type::ack);
+    CHECK(ob.size() == 2);
+}
+
+static void aggregated_views() {
+    order_book ob;
+    ob.add_order(limit(1, side::buy, 100, 5));
+    ob.add_order(limit(2, side::buy, 100, 3));
+    ob.add_order(limit(3, side::buy, 98, 4));
+    ob.add_order(limit(4, side::sell, 103, 2));
+    ob.add_order(limit(5, side::sell, 104, 6));
+    ob.add_order(limit(6, side::sell, 110, 1));
+
+    auto t = ob.top();
+    CHECK(t.bid.price == 100 && t.bid.quantity == 8 && t.bid.orders == 2);
+    CHECK(t.ask.price == 103 && t.ask.quantity == 2 && t.ask.orders == 1);
+
+    std::vector<order_book::book_level> bids, asks;
+    ob.depth_snapshot(2, bids, asks);
+    CHECK(bids.size() == 2 && asks.size() == 2);
+    if (bids.size() == 2 && asks.size() == 2) {
+        CHECK(bids[1].price == 98 && bids[1].quantity == 4 && bids[1].orders == 1);
+        CHECK(asks[1].price == 104 && asks[1].quantity == 6);
+    }
+    ob.depth_snapshot(10, bids, asks);
+    CHECK(bids.size() == 2 && asks.size() == 3);
+
+    CHECK(ob.cancel_order(4));
+    CHECK(ob.cancel_order(5));
+    CHECK(ob.cancel_order(6));
+    t = ob.top();
+    CHECK(t.ask.quantity == 0 && t.ask.orders == 0);
+}
+
+// keeps every depth update the book publishes, in order
+struct depth_recorder : depth_sink {
+    std::vector<depth_update> updates;
+    void publish(const depth_update &u) override { updates.push_back(u); }
+};
+
+struct level_change {
+    side s;
+    price_t price;
+    quantity_t quantity;
+    std::uint32_t orders;
+    depth_update_type type;
+    bool operator==(const level_change &) const = default;
+};
+
+// one update per level touched by an add, a fill, a reduce or a cancel,
+// with the level's new totals, and a zero update once a level is gone
+static void depth_stream() {
+    order_book ob;
+    depth_recorder depth;
+    ob.set_depth_sink(&depth);
+    ob.add_order(limit(1, side::buy, 100, 5));
+    ob.add_order(limit(2, side::buy, 100, 3));
+    ob.add_order(limit(3, side::sell, 101, 4));
+    ob.add_order(limit(4, side::sell, 102, 2));
+    // fills all of order 1 and part of order 2, one update for the level
+    ob.add_order(limit(5, side::sell, 100, 6));
+    CHECK(ob.reduce_order(2, 1));
+    // clears both ask levels and rests the remainder as a new bid level
+    ob.add_order(limit(6, side::buy, 102, 7));
+    CHECK(ob.cancel_order(2));
+    // nothing changes on a reject or a killed fill or kill
+    ob.add_order(limit(6, side::buy, 90, 1));
+    ob.add_order(order_book::order(7, order_type::for_or_kill_limit, side::sell, 102, 5));
+
+    using u = depth_update_type;
+    const std::vector<level_change> expected{
+        {side::buy, 100, 5, 1, u::changed},  {side::buy, 100, 8, 2, u::changed},
+        {side::sell, 101, 4, 1, u::changed}, {side::sell, 102, 2, 1, u::changed},
+        {side::buy, 100, 2, 1, u::changed},  {side::buy, 100, 1, 1, u::changed},
+        {side::sell, 101, 0, 0, u::removed}, {side::sell, 102, 0, 0, u::removed},
+        {side::buy, 102, 1, 1, u::changed},  {side::buy, 100, 0, 0, u::removed},
+    };
+    std::vector<level_change> seen;
+    for (const depth_update &d : depth.updates) {
+        seen.push_back({static_cast<side>(d.side), d.price, d.quantity, d.orders, d.type});
+    }
+    CHECK(seen == expected);
+
+    // the last update of every level still standing is the book's own depth
+    std::map<std::pair<side, price_t>, level_change> levels;
+    for (const level_change &c : seen) {
+        if (c.type == u::removed) {
+            levels.erase({c.s, c.price});
+        } else {
+            levels[{c.s, c.price}] = c;
+        }
+    }
+    std::vector<order_book::book_level> bids, asks;
+    ob.depth_snapshot(10, bids, asks);
+    CHECK(levels.size() == bids.size() + asks.size());
+    for (const auto &[s, book] : {std::pair{side::buy, &bids}, std::pair{side::sell, &asks}}) {
+        for (const order_book::book_level &l : *book) {
+            auto it = levels.find({s, l.price});
+            CHECK(it != levels.end() && it->second.quantity == l.quantity &&
+                  it->second.orders == l.orders);
+        }
+    }
+}
+
+int main() {
+    price_time_priority();
+    cancel_reduce_modify();
+    rejected_replacement();
+    non_resting_types();
+    rejects();
+    aggregated_views();
+    depth_stream();
+    return check_result();
+}
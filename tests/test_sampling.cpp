@@ -0,0 +1,116 @@
+// sampling modes: every mode estimates pi without bias, the variance
+// reduction ones beat plain pseudo random points on the same budget, and
+// the point sets have the structure the modes promise
+#include "sampling.hpp"
+#include "tests/check.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+constexpr sampling_mode all_modes[] = {sampling_mode::pseudo, sampling_mode::antithetic,
+                                       sampling_mode::stratified, sampling_mode::sobol,
+                                       sampling_mode::halton};
+
+// pi from `points` points of a mode, with or without the control
+static running_stats estimate_pi(sampling_mode mode, std::uint64_t seed, std::uint64_t points,
+                                 bool use_control) {
+    point_set set(mode, seed);
+    control_variate control = use_control ? pi_control(seed) : control_variate{};
+    running_stats stats;
+    sample_pi(set, 0, points / set.group_size(), stats, control);
+    return stats;
+}
+
+// the error of an estimate of a multiple of its own error bar: every seed
+// of every mode lands within four standard errors of pi
+static void unbiased() {
+    for (sampling_mode mode : all_modes) {
+        for (bool use_control : {false, true}) {
+            for (std::uint64_t seed : {1, 2, 3, 4}) {
+                running_stats s = estimate_pi(mode, seed, 1 << 18, use_control);
+                CHECK(s.count > 1);
+                CHECK(std::abs(s.mean - std::numbers::pi) <= 4.0 * s.std_error());
+            }
+        }
+    }
+}
+
+// on the same number of points the standard error of the estimate shrinks
+// against plain pseudo random points, by roughly what each mode is known to
+// give for this integrand (antithetic ~0.85, control ~0.65, the grids and
+// nets well under half)
+static void reduces_variance() {
+    const std::uint64_t points = 1 << 20;
+    for (std::uint64_t seed : {1, 2}) {
+        double plain = estimate_pi(sampling_mode::pseudo, seed, points, false).std_error();
+        auto ratio = [&](sampling_mode mode, bool use_control) {
+            return estimate_pi(mode, seed, points, use_control).std_error() / plain;
+        };
+        CHECK(ratio(sampling_mode::antithetic, false) < 0.95);
+        CHECK(ratio(sampling_mode::pseudo, true) < 0.8);
+        CHECK(ratio(sampling_mode::stratified, false) < 0.5);
+        CHECK(ratio(sampling_mode::sobol, false) < 0.5);
+        CHECK(ratio(sampling_mode::halton, false) < 0.5);
+    }
+}
+
+// coordinates strictly inside (0, 1), and a range filled in pieces gives the
+// same points as filled at once, whichever point a piece starts on
+static void point_structure() {
+    const size_t n = 3000;
+    for (sampling_mode mode : all_modes) {
+        point_set set(mode, 9, 256);
+        for (size_t pair : {size_t{0}, size_t{3}}) {
+            std::vector<double> u(n), v(n), pu(n), pv(n);
+            set.fill(pair, 5, n, u.data(), v.data());
+            bool inside = true;
+            for (size_t i = 0; i < n; ++i) {
+                inside = inside && u[i] > 0.0 && u[i] < 1.0 && v[i] > 0.0 && v[i] < 1.0;
+            }
+            CHECK(inside);
+            for (size_t cut : {size_t{1}, size_t{2}, size_t{255}, size_t{1000}}) {
+                set.fill(pair, 5, cut, pu.data(), pv.data());
+                set.fill(pair, 5 + cut, n - cut, pu.data() + cut, pv.data() + cut);
+                CHECK(pu == u && pv == v);
+            }
+        }
+    }
+
+    // antithetic points mirror the one before them, also across a range
+    // that starts on the second point of a pair
+    point_set antithetic(sampling_mode::antithetic, 9);
+    std::vector<double> u(101), v(101);
+    antithetic.fill(1, 0, 101, u.data(), v.data());
+    bool mirrored = true;
+    for (size_t i = 1; i < 101; i += 2) {
+        mirrored = mirrored && u[i] == 1.0 - u[i - 1] && v[i] == 1.0 - v[i - 1];
+    }
+    CHECK(mirrored);
+    double a, b;
+    antithetic.fill(1, 7, 1, &a, &b);
+    CHECK(a == u[7] && b == v[7]);
+
+    // a stratified group has exactly one point in every cell of its grid,
+    // for the ordered first pair and the shuffled ones
+    point_set stratified(sampling_mode::stratified, 9, 64);
+    for (size_t pair : {size_t{0}, size_t{2}}) {
+        std::vector<double> su(128), sv(128);
+        stratified.fill(pair, 0, 128, su.data(), sv.data());
+        for (size_t group = 0; group < 2; ++group) {
+            std::vector<int> cells(64, 0);
+            for (size_t i = group * 64; i < group * 64 + 64; ++i) {
+                cells[static_cast<size_t>(sv[i] * 8) * 8 + static_cast<size_t>(su[i] * 8)]++;
+            }
+            CHECK(std::count(cells.begin(), cells.end(), 1) == 64);
+        }
+    }
+}
+
+int main() {
+    unbiased();
+    reduces_variance();
+    point_structure();
+    return check_result();
+}
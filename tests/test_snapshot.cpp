@@ -0,0 +1,186 @@
+// snapshot + journal restart: restoring a snapshot and replaying the rest of
+// the feed on top gives the book a full replay gives, and damaged files are
+// refused
+#include "feed.hpp"
+#include "snapshot.hpp"
+#include "tests/check.hpp"
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using resting_t =
+    std::tuple<order_id_t, quantity_t, price_t, order_book::side, order_book::order_type>;
+
+// every resting order with its queue position, in snapshot order
+static std::vector<resting_t> resting(const order_book &ob) {
+    std::vector<resting_t> out;
+    ob.for_each_order([&](const order_book::order &o) {
+        out.emplace_back(o.get_id(), o.get_quantity(), o.get_price(), o.get_side(),
+                         o.get_type());
+    });
+    return out;
+}
+
+// cut the feed at several points, snapshot there, journal the rest and
+// compare the restarted book with one that saw every message
+static void restart_matches_full_replay(const fs::path &dir) {
+    const instrument inst{};
+    feed_generator gen(7, inst.to_ticks(100.0));
+    std::vector<message> feed(50000);
+    for (message &m : feed) {
+        m = gen.next();
+    }
+    order_book full(inst, 1 << 16);
+    for (const message &m : feed) {
+        apply(full, m);
+    }
+    CHECK(full.size() != 0);
+
+    const std::string snapshot_path = (dir / "book.snap").string();
+    const std::string journal_path = (dir / "book.journal").string();
+    for (size_t cut : {size_t{0}, size_t{1}, size_t{12345}, size_t{49999}, feed.size()}) {
+        {
+            order_book live(inst, 1 << 16);
+            for (size_t i = 0; i < cut; ++i) {
+                apply(live, feed[i]);
+            }
+            write_snapshot(live, snapshot_path, cut, 256);
+            feed_writer journal(journal_path, inst);
+            for (size_t i = cut; i < feed.size(); ++i) {
+                journal.write(feed[i]);
+            }
+        }
+        CHECK(!fs::exists(snapshot_path + ".partial"));
+
+        mapped_snapshot snap(snapshot_path);
+        CHECK(snap.sequence() == cut);
+        CHECK(snap.get_instrument().price_band == inst.price_band);
+        order_book restarted(snap.get_instrument(), 1 << 16);
+        load_snapshot(restarted, snap);
+        CHECK(restarted.size() == snap.size());
+        mapped_feed journal(journal_path);
+        CHECK(journal.size() == feed.size() - cut);
+        for (const message &m : journal) {
+            apply(restarted, m);
+        }
+        CHECK(resting(restarted) == resting(full));
+        CHECK(restarted.best_bid() == full.best_bid());
+        CHECK(restarted.best_ask() == full.best_ask());
+    }
+}
+
+// overwrite one field of a file in place
+template <class T> static void patch(const std::string &path, size_t offset, T value) {
+    std::FILE *file = std::fopen(path.c_str(), "r+b");
+    CHECK(file != nullptr);
+    if (!file) {
+        return;
+    }
+    std::fseek(file, static_cast<long>(offset), SEEK_SET);
+    std::fwrite(&value, sizeof(value), 1, file);
+    std::fclose(file);
+}
+
+template <class mapped_t> static bool opens(const std::string &path) {
+    try {
+        mapped_t mapped(path);
+        return true;
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+}
+
+// a count larger than the file, including one whose byte size wraps, is
+// refused rather than read past the mapping, and so are header sizes and
+// record fields the book cannot use
+static void damaged_files(const fs::path &dir) {
+    const instrument inst{};
+    order_book ob(inst);
+    ob.add_order(order_book::order(1, order_book::order_type::limit, order_book::side::buy,
+                                   100, 5));
+    const std::string snapshot_path = (dir / "damaged.snap").string();
+    const std::string feed_path = (dir / "damaged.feed").string();
+    write_snapshot(ob, snapshot_path, 1);
+    {
+        feed_writer out(feed_path, inst);
+        out.write(message{1, 5, 100, message_type::add, order_book::side::buy,
+                          order_book::order_type::limit});
+    }
+    CHECK(opens<mapped_snapshot>(snapshot_path));
+    CHECK(opens<mapped_feed>(feed_path));
+
+    const size_t snapshot_count = offsetof(snapshot_header, count);
+    const size_t feed_count = offsetof(feed_header, count);
+    for (std::uint64_t count : {std::uint64_t{2}, (std::uint64_t{1} << 63) + 1,
+                                ~std::uint64_t{0}}) {
+        patch(snapshot_path, snapshot_count, count);
+        CHECK(!opens<mapped_snapshot>(snapshot_path));
+        patch(feed_path, feed_count, count);
+        CHECK(!opens<mapped_feed>(feed_path));
+    }
+
+    // ladder sizes that would size the book's level arrays from garbage
+    for (auto [span, band] : {std::pair<price_t, price_t>{0, 0}, {-5, 0}, {1 << 20, 0},
+                              {64, 128}, {64, -1}}) {
+        write_snapshot(ob, snapshot_path, 1);
+        patch(snapshot_path, offsetof(snapshot_header, ladder_span), span);
+        patch(snapshot_path, offsetof(snapshot_header, price_band), band);
+        CHECK(!opens<mapped_snapshot>(snapshot_path));
+    }
+    write_snapshot(ob, snapshot_path, 1);
+    patch(snapshot_path, offsetof(snapshot_header, ladder_span), price_t{64});
+    patch(snapshot_path, offsetof(snapshot_header, price_band), price_t{129});
+    CHECK(opens<mapped_snapshot>(snapshot_path));
+
+    // records whose side or type byte is out of range are refused on load
+    const size_t record = sizeof(snapshot_header);
+    for (auto [field, byte] : {std::pair<size_t, std::uint8_t>{offsetof(snapshot_order, side), 2},
+                               {offsetof(snapshot_order, side), 255},
+                               {offsetof(snapshot_order, order_type), 5}}) {
+        write_snapshot(ob, snapshot_path, 1);
+        patch(snapshot_path, record + field, byte);
+        mapped_snapshot snap(snapshot_path);
+        order_book restored(snap.get_instrument());
+        bool refused = false;
+        try {
+            load_snapshot(restored, snap);
+        } catch (const std::runtime_error &) {
+            refused = true;
+        }
+        CHECK(refused);
+    }
+
+    // out of range enum bytes are dropped before they reach the book
+    order_book replayed(inst);
+    message m{2, 5, 100, message_type::add, order_book::side::buy,
+              order_book::order_type::limit};
+    message bad_type = m, bad_side = m, bad_order_type = m;
+    bad_type.type = static_cast<message_type>(4);
+    bad_side.side = static_cast<order_book::side>(2);
+    bad_order_type.order_type = static_cast<order_book::order_type>(5);
+    CHECK(!apply(replayed, bad_type));
+    CHECK(!apply(replayed, bad_side));
+    CHECK(!apply(replayed, bad_order_type));
+    CHECK(replayed.size() == 0);
+    CHECK(apply(replayed, m));
+    CHECK(replayed.size() == 1);
+}
+
+int main() {
+    std::string pattern = (fs::temp_directory_path() / "test_snapshot.XXXXXX").string();
+    if (!::mkdtemp(pattern.data())) {
+        std::cerr << "cannot create a temporary directory\n";
+        return EXIT_FAILURE;
+    }
+    const fs::path dir = pattern;
+    restart_matches_full_replay(dir);
+    damaged_files(dir);
+    fs::remove_all(dir);
+    return check_result();
+}
@@ -0,0 +1,112 @@
+// task_group: predecessors, continuations, per group waits, nested waits
+// from inside the pool and empty handles
+#include "tests/check.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// a fan out, a fan in after it and a continuation after that, every stage
+// checks the one before it has fully finished
+static void stages(thread_pool &pool) {
+    for (int rep = 0; rep < 200; ++rep) {
+        std::atomic<int> pieces{0}, joined{0}, continued{0};
+        std::atomic<bool> out_of_order{false};
+        thread_pool::task_group group(pool);
+        std::vector<thread_pool::task_handle> fan_out;
+        for (int i = 0; i < 8; ++i) {
+            fan_out.push_back(group.run([&]() { pieces.fetch_add(1); }));
+        }
+        auto fan_in = group.run_after(fan_out, [&]() {
+            out_of_order = out_of_order || pieces.load() != 8;
+            joined.fetch_add(1);
+        });
+        auto last = fan_in.then([&]() {
+            out_of_order = out_of_order || joined.load() != 1;
+            continued.fetch_add(1);
+        });
+        group.wait();
+        CHECK(!out_of_order);
+        CHECK(continued.load() == 1);
+        CHECK(last.done());
+        // a continuation of a finished task is ready straight away
+        last.then([&]() { continued.fetch_add(1); });
+        group.wait();
+        CHECK(continued.load() == 2);
+    }
+}
+
+// a worker waiting on an inner group keeps running queued tasks, so this
+// finishes even on a single worker
+static void nested(thread_pool &pool) {
+    thread_pool::task_group outer(pool);
+    std::atomic<int> inner_done{0};
+    for (int i = 0; i < 4; ++i) {
+        outer.run([&]() {
+            thread_pool::task_group inner(pool);
+            std::atomic<int> count{0};
+            for (int k = 0; k < 16; ++k) {
+                inner.run([&]() { count.fetch_add(1); });
+            }
+            inner.wait();
+            if (count.load() == 16) {
+                inner_done.fetch_add(1);
+            }
+        });
+    }
+    outer.wait();
+    CHECK(inner_done.load() == 4);
+}
+
+// waiting on one group does not wait for unrelated work in the pool
+static void independent(thread_pool &pool) {
+    std::atomic<bool> release{false};
+    pool.post([&]() {
+        while (!release.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    thread_pool::task_group group(pool);
+    std::atomic<int> ran{0};
+    group.run([&]() { ran.fetch_add(1); });
+    group.wait();
+    CHECK(ran.load() == 1);
+    release = true;
+    pool.wait_for_tasks();
+}
+
+static void empty_handle() {
+    thread_pool::task_handle empty;
+    CHECK(!empty);
+    bool threw = false;
+    try {
+        empty.then([]() {});
+    } catch (const std::logic_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+    threw = false;
+    try {
+        (void)empty.done();
+    } catch (const std::logic_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main() {
+    for (auto mode : {thread_pool::scheduling::shared_queue, thread_pool::scheduling::work_stealing}) {
+        for (size_t threads : {1, 2, 4}) {
+            thread_pool pool(threads, mode);
+            stages(pool);
+            nested(pool);
+            if (threads > 1) {
+                independent(pool);
+            }
+        }
+    }
+    empty_handle();
+    return check_result();
+}
@@ -0,0 +1,146 @@
+// thread_pool: every idle policy picks up work after going idle and shuts
+// down cleanly in either scheduling mode, and pinning either puts each
+// worker on its core or fails the constructor
+#include "tests/check.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <dlfcn.h>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// the pool calls pthread_setaffinity_np from this executable, so defining it
+// here interposes on the C library's. with fail_pinning set it refuses
+// like the kernel would for a cpu the thread may not use.
+static std::atomic<bool> fail_pinning{false};
+static std::atomic<int> pin_calls{0};
+
+extern "C" int pthread_setaffinity_np(pthread_t thread, size_t size,
+                                      const cpu_set_t *set) noexcept {
+    pin_calls.fetch_add(1);
+    if (fail_pinning.load()) {
+        return EINVAL;
+    }
+    using real_t = int (*)(pthread_t, size_t, const cpu_set_t *);
+    static const real_t real =
+        reinterpret_cast<real_t>(::dlsym(RTLD_NEXT, "pthread_setaffinity_np"));
+    return real(thread, size, set);
+}
+
+template <class E, class F> static bool throws(F &&f) {
+    try {
+        f();
+    } catch (const E &) {
+        return true;
+    }
+    return false;
+}
+
+// submit after the workers have spun out and gone to whatever they do when
+// idle, twice, then destroy the pool with the workers idle
+static void idle_policies() {
+    using idle = thread_pool::idle_policy;
+    // a pure spinner owns its core, keep one core free for the test thread
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (auto mode : {thread_pool::scheduling::shared_queue, thread_pool::scheduling::work_stealing}) {
+        for (auto policy : {idle::block, idle::spin, idle::spin_then_yield, idle::spin_then_park}) {
+            for (int spin_count : {0, 256}) {
+                size_t threads =
+                    policy == idle::spin ? std::clamp<size_t>(cores - 1, 1, 2) : 3;
+                thread_pool pool(threads, thread_pool::options{mode, policy, spin_count, {}});
+                for (int round = 0; round < 2; ++round) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    std::atomic<int> ran{0};
+                    for (int i = 0; i < 100; ++i) {
+                        pool.post([&ran]() { ran.fetch_add(1); });
+                    }
+                    std::future<int> answer = pool.enqueue([]() { return 42; });
+                    pool.wait_for_tasks();
+                    CHECK(ran.load() == 100);
+                    CHECK(answer.get() == 42);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+    }
+}
+
+// the cpus this process may run on
+static std::vector<int> allowed_cores() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> cores;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (CPU_ISSET(c, &set)) {
+                cores.push_back(c);
+            }
+        }
+    }
+    return cores;
+}
+
+static void pinning() {
+    std::vector<int> allowed = allowed_cores();
+    CHECK(!allowed.empty());
+    if (allowed.empty()) {
+        return;
+    }
+    auto options_for = [](std::vector<int> cores) {
+        return thread_pool::options{thread_pool::scheduling::work_stealing,
+                                    thread_pool::idle_policy::spin_then_park, 256,
+                                    std::move(cores)};
+    };
+
+    // pinned workers run on their core and may not leave it
+    const int core = allowed.back();
+    {
+        thread_pool pool(2, options_for({core}));
+        for (int i = 0; i < 4; ++i) {
+            std::future<bool> on_core = pool.enqueue([core]() {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+                return CPU_COUNT(&set) == 1 && CPU_ISSET(core, &set) && sched_getcpu() == core;
+            });
+            CHECK(on_core.get());
+        }
+    }
+    // the pool went through the interposed call, so the failure below is real
+    CHECK(pin_calls.load() == 2);
+
+    // cores the process cannot use are refused before any worker starts
+    CHECK(throws<std::invalid_argument>([&]() { thread_pool pool(1, options_for({-1})); }));
+    CHECK(throws<std::invalid_argument>(
+        [&]() { thread_pool pool(1, options_for({CPU_SETSIZE})); }));
+    int missing = 0;
+    while (std::find(allowed.begin(), allowed.end(), missing) != allowed.end()) {
+        ++missing;
+    }
+    if (missing < CPU_SETSIZE) {
+        CHECK(throws<std::invalid_argument>(
+            [&]() { thread_pool pool(1, options_for({core, missing})); }));
+    }
+
+    // a worker the kernel refuses to pin fails the constructor, the workers
+    // that did start are joined, and the next pool pins fine
+    fail_pinning = true;
+    for (auto mode : {thread_pool::scheduling::shared_queue, thread_pool::scheduling::work_stealing}) {
+        thread_pool::options options = options_for({core});
+        options.mode = mode;
+        CHECK(throws<std::runtime_error>([&]() { thread_pool pool(3, options); }));
+    }
+    fail_pinning = false;
+    thread_pool pool(1, options_for({core}));
+    CHECK(pool.enqueue([]() { return 1; }).get() == 1);
+}
+
+int main() {
+    idle_policies();
+    pinning();
+    return check_result();
+}
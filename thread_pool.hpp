@@ -1,44 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <future>
+#include <latch>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "latency.hpp"
+#include "task.hpp"
+
+// busy wait hint for spin loops
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
 class thread_pool {
   public:
-    thread_pool(size_t total_threads) {
+    // shared_queue: one queue behind a mutex, fair and simple.
+    // work_stealing: every worker owns a deque, pushes and pops its own end
+    // (LIFO, cache warm) and steals from the other end of a random victim
+    // when it runs dry, so small tasks stop fighting over one lock. tasks
+    // enqueued from outside the pool land in a shared injection queue.
+    enum class scheduling { shared_queue, work_stealing };
+
+    // what a worker does when it runs out of tasks.
+    // block: sleep on a condition variable right away, every wakeup is a
+    //   futex call.
+    // spin: busy poll until work shows up. wakeups in well under a
+    //   microsecond, but the worker owns its core, so only for pools with
+    //   fewer workers than cores (ideally pinned ones).
+    // spin_then_yield: busy poll for spin_count rounds, then keep polling
+    //   with a yield in between so other threads get the core.
+    // spin_then_park: busy poll for spin_count rounds, then sleep.
+    enum class idle_policy { block, spin, spin_then_yield, spin_then_park };
+
+    struct options {
+        scheduling mode = scheduling::shared_queue;
+        idle_policy idle = idle_policy::block;
+        // rounds of cpu_relax before a spin_then_* worker gives up
+        int spin_count = 256;
+        // worker i runs on cores[i % cores.size()], empty leaves placement
+        // to the OS. the constructor throws if a worker cannot be pinned.
+        // a pinned work_stealing worker also allocates its own deque, so
+        // with the kernel's first touch policy it sits on the worker's NUMA
+        // node. shared_queue workers have no state of their own to place.
+        std::vector<int> cores;
+    };
+
+    // shared_queue workers block, work_stealing workers spin briefly and
+    // then park
+    thread_pool(size_t total_threads, scheduling mode = scheduling::shared_queue)
+        : thread_pool(total_threads,
+                      options{mode,
+                              mode == scheduling::work_stealing ? idle_policy::spin_then_park
+                                                                : idle_policy::block,
+                              256,
+                              {}}) {}
+
+    thread_pool(size_t total_threads, const options &opts)
+        : mode(opts.mode), idle(opts.idle), spin_count(opts.spin_count), cores(opts.cores),
+          started(static_cast<std::ptrdiff_t>(total_threads) + 1) {
+        check_cores(cores);
+        if (mode == scheduling::work_stealing) {
+            local_queues.resize(total_threads);
+        }
         for (size_t i = 0; i < total_threads; ++i) {
-            all_threads.emplace_back([this]() {
-                while (true) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(q_mutex);
-                        cv_task.wait(
-                            lock, [this]() { return stop || !tasks.empty(); });
-                        if (stop && tasks.empty()) {
-                            return; // exit thread
-                        }
-                        task = std::move(tasks.front()); // extract the task
-                        tasks.pop(); // remove task from the queue
-                    }
-                    // track active task
-                    active_tasks.fetch_add(1, std::memory_order_relaxed);
-                    // if i donot use scopes, then it will run task with lock
-                    // which can create deadlock, alternative is to unlock before
-                    // running the task and lock after that but it creates overhead
-                    task(); // execute the task
-
-                    // mark task as done
-                    active_tasks.fetch_sub(1, std::memory_order_relaxed);
-
-                    // wake up any waiters
-                    std::unique_lock<std::mutex> wait_lock(wait_mutex);
-                    if (tasks.empty() && active_tasks.load() == 0)
-                        cv_wait.notify_all();
-                }
-            });
+            if (mode == scheduling::work_stealing) {
+                all_threads.emplace_back([this, i]() { stealing_worker(i); });
+            } else {
+                all_threads.emplace_back([this, i]() { shared_queue_worker(i); });
+            }
+        }
+        // every worker has tried to pin itself once this returns
+        started.arrive_and_wait();
+        if (size_t failed = pin_failures.load()) {
+            shutdown();
+            throw std::runtime_error("thread_pool could not pin " + std::to_string(failed) +
+                                     " worker(s)");
         }
     }
 
@@ -63,40 +117,213 @@ class thread_pool {
         std::invoke_result<F, Args...>	                         Deduces the function’s return type
         std::bind	                                             Pre-binds arguments to make a zero-arg callable
         std::packaged_task<return_type()>	                     Wraps callable so it can produce a std::future
-        std::make_shared	                                     Safely shares the task between threads
-        task->get_future()	                                     Gives the caller a handle to wait for the result
+        task	                                                 Move only wrapper that carries it through the queue
+        job.get_future()	                                      Gives the caller a handle to wait for the result
         */
-        auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        // the packaged_task is move only and small enough to sit inside the
+        // queued task, so queueing it allocates nothing. the future side
+        // still costs two allocations per call: the shared state, which
+        // holds the bound callable, and the separate slot for its result.
+        // post() avoids both when no result is needed.
+        std::packaged_task<return_type()> job(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
-        std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(q_mutex);
-            tasks.emplace([task]() { (*task)(); });
-        }
-        cv_task.notify_one();
+        std::future<return_type> res = job.get_future();
+        submit(task(std::move(job)));
         return res;
     }
+
+    // fire and forget, no future and no shared state. small callables are
+    // queued without any heap allocation.
+    template <class F> void post(F &&f) { submit(task(std::forward<F>(f))); }
+
+  private:
+    struct graph_node;
+
+    // tasks of a task_group not finished yet, and where its waiters sleep
+    struct group_state {
+        std::atomic<size_t> unfinished{0};
+        std::mutex m;
+        std::condition_variable cv;
+    };
+
+  public:
+    // a task submitted through a task_group. successors can be attached
+    // until and after it finishes, a successor of a finished task is
+    // simply ready straight away.
+    class task_handle {
+      public:
+        // an empty handle, only good for assigning a real one to. then()
+        // and done() on it throw std::logic_error.
+        task_handle() = default;
+
+        explicit operator bool() const { return node != nullptr; }
+
+        // f runs once this task has finished, as part of the same group
+        template <class F> task_handle then(F &&f) const {
+            check();
+            return node->pool.add_node(node->group, this, this + 1, std::forward<F>(f));
+        }
+
+        bool done() const {
+            check();
+            std::lock_guard<std::mutex> lock(node->m);
+            return node->finished;
+        }
+
+      private:
+        friend class thread_pool;
+        explicit task_handle(std::shared_ptr<graph_node> node) : node(std::move(node)) {}
+        void check() const {
+            if (!node) {
+                throw std::logic_error("empty task_handle");
+            }
+        }
+        std::shared_ptr<graph_node> node;
+    };
+
+    // tasks that are waited for together, without waiting for anything
+    // else the pool runs. a task can name predecessors and only becomes
+    // ready to run once all of them have finished, so dependent stages
+    // (decode -> match -> publish, path-gen -> payoff -> reduce) pipeline
+    // through the pool with no barrier between them. tasks must not throw.
+    class task_group {
+      public:
+        explicit task_group(thread_pool &pool)
+            : pool(pool), state(std::make_shared<group_state>()) {}
+
+        task_group(const task_group &) = delete;
+        task_group &operator=(const task_group &) = delete;
+
+        // the tasks usually capture the caller's state, so they have to be
+        // done before it goes away
+        ~task_group() { wait(); }
+
+        template <class F> task_handle run(F &&f) {
+            return pool.add_node(state, nullptr, nullptr, std::forward<F>(f));
+        }
+
+        // f runs once every task in after has finished, empty handles are
+        // ignored
+        template <class F> task_handle run_after(const std::vector<task_handle> &after, F &&f) {
+            return pool.add_node(state, after.data(), after.data() + after.size(),
+                                 std::forward<F>(f));
+        }
+
+        // until every task of this group, successors included, has
+        // finished. a pool worker runs other queued tasks meanwhile rather
+        // than block a thread the group may be waiting for.
+        void wait() {
+            if (current_pool == &pool) {
+                while (!done()) {
+                    if (!pool.run_one()) {
+                        std::this_thread::yield();
+                    }
+                }
+                return;
+            }
+            std::unique_lock<std::mutex> lock(state->m);
+            state->cv.wait(lock, [this]() { return done(); });
+        }
+
+        bool done() const { return state->unfinished.load(std::memory_order_acquire) == 0; }
+
+      private:
+        thread_pool &pool;
+        std::shared_ptr<group_state> state;
+    };
+
     // often return too early before tasks are finished.
     // void pool_wait() {
     //     std::unique_lock<std::mutex> lock(q_mutex);
     //     cv_task.wait(lock, [this] { return tasks.empty(); });
     // }
 
+    // waits for every task in the pool, whoever submitted it. task_group
+    // waits for one batch only.
     void wait_for_tasks() {
         std::unique_lock<std::mutex> lock(wait_mutex);
+        if (mode == scheduling::work_stealing) {
+            cv_wait.wait(lock, [this]() {
+                return unfinished.load(std::memory_order_acquire) == 0;
+            });
+            return;
+        }
         cv_wait.wait(lock, [this]() {
             std::unique_lock<std::mutex> q_lock(q_mutex);
             return tasks.empty() && active_tasks.load() == 0;
         });
     }
-    
 
-    ~thread_pool() {
+    // body(begin, end) over [first, last) split into chunks of grain
+    // indices. the calling thread works through chunks alongside the pool
+    // and the call returns once the whole range is done. grain 0 picks one
+    // that gives every participant about eight chunks. body must not throw.
+    template <class F>
+    void parallel_for(size_t first, size_t last, F &&body, size_t grain = 0) {
+        for_each_chunk<char>(first, last, grain, char{},
+                             [&body](size_t begin, size_t end, char &) { body(begin, end); });
+    }
+
+    // body(begin, end, acc) folds a chunk into the accumulator of whichever
+    // thread runs it, every participant starts from identity. the
+    // accumulators are merged with combine(a, b) -> T on the calling thread
+    // once all chunks are done, so body never needs a lock or a global.
+    template <class T, class F, class C>
+    T parallel_reduce(size_t first, size_t last, T identity, F &&body, C &&combine,
+                      size_t grain = 0) {
+        auto accumulators = for_each_chunk<T>(first, last, grain, identity, body);
+        T result = identity;
+        for (auto &acc : accumulators) {
+            result = combine(result, acc.value);
+        }
+        return result;
+    }
+
+    // like parallel_reduce, but every chunk of grain indices folds into an
+    // accumulator of its own, and those are combined in chunk order on the
+    // calling thread. the chunks only depend on the range and the grain, so
+    // a combine that is not associative in floating point (merging running
+    // means) gives the same bits on any pool and under any scheduling.
+    template <class T, class F, class C>
+    T parallel_reduce_ordered(size_t first, size_t last, T identity, F &&body, C &&combine,
+                              size_t grain) {
+        if (first >= last) {
+            return identity;
+        }
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (last - first - 1) / grain + 1;
+        std::vector<padded<T>> partial(chunks, padded<T>{identity});
+        parallel_for(
+            0, chunks,
+            [&](size_t begin, size_t end) {
+                for (size_t c = begin; c < end; ++c) {
+                    size_t lo = first + c * grain;
+                    body(lo, std::min(lo + grain, last), partial[c].value);
+                }
+            },
+            1);
+        T result = identity;
+        for (auto &acc : partial) {
+            result = combine(result, acc.value);
+        }
+        return result;
+    }
+
+    ~thread_pool() { shutdown(); }
+
+  private:
+    // wake every worker, let them drain the queues and join them
+    void shutdown() {
         std::unique_lock<std::mutex> lock(q_mutex);
         stop = true;
         lock.unlock();
         cv_task
             .notify_all(); // wake up all threads to finish their tasks and exit
+        {
+            std::unique_lock<std::mutex> park_lock(park_mutex);
+            stopping.store(true);
+        }
+        cv_park.notify_all();
         for (auto &thread : all_threads) {
             if (thread.joinable()) {
                 thread.join();
@@ -104,14 +331,517 @@ class thread_pool {
         }
     }
 
-  private:
+    template <class T> struct alignas(64) padded {
+        T value;
+    };
+
+    // a task_group task and the edges to the tasks that wait for it. pending
+    // counts unfinished predecessors plus one that add_node holds while it
+    // links them, so the node cannot become ready halfway through.
+    // the tasks waiting for a node. most nodes have one or two (a
+    // continuation, a fan in) and those sit inline, more spill to a vector.
+    // the node is then a single allocation, its shared_ptr block included.
+    struct successor_list {
+        std::array<std::shared_ptr<graph_node>, 2> first;
+        size_t count{0};
+        std::vector<std::shared_ptr<graph_node>> more;
+
+        void push_back(std::shared_ptr<graph_node> node) {
+            if (count < first.size()) {
+                first[count] = std::move(node);
+            } else {
+                more.push_back(std::move(node));
+            }
+            ++count;
+        }
+
+        template <class F> void for_each(F &&f) const {
+            for (size_t i = 0; i < std::min(count, first.size()); ++i) {
+                f(first[i]);
+            }
+            for (const auto &node : more) {
+                f(node);
+            }
+        }
+    };
+
+    struct graph_node {
+        graph_node(thread_pool &pool, std::shared_ptr<group_state> group, task &&body)
+            : pool(pool), group(std::move(group)), body(std::move(body)) {}
+
+        thread_pool &pool;
+        std::shared_ptr<group_state> group;
+        task body;
+        std::atomic<size_t> pending{1};
+        mutable std::mutex m;
+        bool finished{false};      // guarded by m
+        successor_list successors; // guarded by m
+    };
+
+    template <class F>
+    task_handle add_node(const std::shared_ptr<group_state> &group, const task_handle *first,
+                         const task_handle *last, F &&f) {
+        group->unfinished.fetch_add(1, std::memory_order_relaxed);
+        auto node = std::make_shared<graph_node>(*this, group, task(std::forward<F>(f)));
+        for (; first != last; ++first) {
+            if (!first->node) {
+                continue;
+            }
+            graph_node &pred = *first->node;
+            std::lock_guard<std::mutex> lock(pred.m);
+            if (!pred.finished) {
+                node->pending.fetch_add(1, std::memory_order_relaxed);
+                pred.successors.push_back(node);
+            }
+        }
+        release(node);
+        return task_handle(std::move(node));
+    }
+
+    // one predecessor (or add_node itself) is done, the last one queues
+    // the node. the queued task keeps the node alive until it has run.
+    void release(const std::shared_ptr<graph_node> &node) {
+        if (node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            post([node]() { node->pool.run_node(*node); });
+        }
+    }
+
+    void run_node(graph_node &node) {
+        node.body();
+        node.body.reset();
+        successor_list ready;
+        {
+            std::lock_guard<std::mutex> lock(node.m);
+            node.finished = true;
+            ready = std::move(node.successors);
+        }
+        ready.for_each([this](const std::shared_ptr<graph_node> &next) { release(next); });
+        // the successors are counted already, so the group cannot look
+        // done between a task and the ones it unblocked
+        group_state &group = *node.group;
+        if (group.unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(group.m);
+            group.cv.notify_all();
+        }
+    }
+
+    // chunks are handed out from one atomic counter, so a participant that
+    // gets preempted or lands on slow chunks simply takes fewer of them.
+    // helpers that only get to run after the range is finished back out
+    // without touching the accumulators, which keeps a nested call from
+    // waiting on workers that are busy elsewhere.
+    template <class T> struct chunked_range {
+        chunked_range(size_t first, size_t last, size_t grain, size_t participants,
+                      const T &identity)
+            : next(first), last(last), grain(grain),
+              accumulators(participants, padded<T>{identity}) {}
+
+        template <class F> void run(size_t slot, F &body) {
+            T &acc = accumulators[slot].value;
+            while (true) {
+                size_t begin = next.fetch_add(grain, std::memory_order_relaxed);
+                if (begin >= last) {
+                    return;
+                }
+                body(begin, std::min(begin + grain, last), acc);
+            }
+        }
+
+        alignas(64) std::atomic<size_t> next;
+        size_t last;
+        size_t grain;
+        std::vector<padded<T>> accumulators;
+        // slot 0 is the caller, helpers take the next one. closing adds
+        // closed so late helpers see a slot past the end.
+        alignas(64) std::atomic<size_t> joined{1};
+        std::atomic<size_t> finished{0};
+        static constexpr size_t closed = size_t{1} << 32;
+    };
+
+    template <class T, class F>
+    std::vector<padded<T>> for_each_chunk(size_t first, size_t last, size_t grain,
+                                          const T &identity, F &&body) {
+        if (first >= last) {
+            return {};
+        }
+        size_t n = last - first;
+        size_t participants = all_threads.size() + 1;
+        if (grain == 0) {
+            grain = std::max<size_t>(1, n / (participants * 8));
+        }
+        size_t helpers = std::min(all_threads.size(), (n - 1) / grain);
+        auto range = std::make_shared<chunked_range<T>>(first, last, grain,
+                                                         helpers + 1, identity);
+        for (size_t i = 0; i < helpers; ++i) {
+            post([range, &body]() {
+                size_t slot = range->joined.fetch_add(1, std::memory_order_acq_rel);
+                if (slot >= chunked_range<T>::closed) {
+                    return;
+                }
+                range->run(slot, body);
+                range->finished.fetch_add(1, std::memory_order_release);
+            });
+        }
+        range->run(0, body);
+        size_t joined =
+            range->joined.fetch_add(chunked_range<T>::closed, std::memory_order_acq_rel);
+        while (range->finished.load(std::memory_order_acquire) != joined - 1) {
+            std::this_thread::yield();
+        }
+        return std::move(range->accumulators);
+    }
+
     std::vector<std::thread> all_threads;
-    std::queue<std::function<void()>>
-        tasks; // can send anything inside the queue that is what function<void()> is
+    task_deque tasks; // can send any void() callable inside the queue
     std::mutex q_mutex;
     std::condition_variable cv_task;
     std::atomic<size_t> active_tasks{0};
     std::condition_variable cv_wait;
     std::mutex wait_mutex;
     bool stop{false};
+    size_t waiting_workers{0}; // guarded by q_mutex
+
+    scheduling mode;
+    idle_policy idle;
+    int spin_count;
+    std::vector<int> cores;
+    // workers and the constructor wait here until every worker has set
+    // itself up, so nobody steals from a queue that does not exist yet
+    std::latch started;
+    std::atomic<size_t> pin_failures{0};
+
+    // work stealing state. every deque is a short critical section behind
+    // its own spin lock, so the owner only contends with the odd thief.
+    struct alignas(64) worker_queue {
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        task_deque tasks;
+
+        // the holder may be preempted while more threads than cores are
+        // running, so stop burning the core after a short spin
+        void lock() {
+            for (int spin = 0; busy.test_and_set(std::memory_order_acquire); ++spin) {
+                if (spin < 64) {
+                    cpu_relax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        bool try_lock() { return !busy.test_and_set(std::memory_order_acquire); }
+        void unlock() { busy.clear(std::memory_order_release); }
+    };
+    std::vector<std::unique_ptr<worker_queue>> local_queues;
+    worker_queue injected;
+    // tasks sitting in some queue, what idle workers poll. the shared queue
+    // updates it under q_mutex.
+    std::atomic<size_t> queued{0};
+    // tasks enqueued and not finished yet, for wait_for_tasks
+    std::atomic<size_t> unfinished{0};
+    std::atomic<size_t> sleepers{0};
+    std::atomic<size_t> searching{0};
+    std::atomic<bool> stopping{false};
+    std::mutex park_mutex;
+    std::condition_variable cv_park;
+
+    // which pool and worker the current thread belongs to
+    static inline thread_local thread_pool *current_pool = nullptr;
+    static inline thread_local size_t current_worker = 0;
+    // victim order for steal()
+    static inline thread_local std::uint64_t current_rng = 0;
+
+    void submit(task &&t) {
+#ifdef QUANT_INSTRUMENTATION
+        t.queued_at = latency_clock::now();
+#endif
+        if (mode == scheduling::work_stealing) {
+            push_local(std::move(t));
+            return;
+        }
+        bool wake;
+        {
+            std::unique_lock<std::mutex> lock(q_mutex);
+            tasks.push_back(std::move(t));
+            queued.fetch_add(1, std::memory_order_relaxed);
+            wake = waiting_workers > 0;
+        }
+        // nobody to wake while every worker is busy or polling, skip the
+        // syscall
+        if (wake) {
+            cv_task.notify_one();
+        }
+    }
+
+    // runs and destroys a dequeued task. with QUANT_INSTRUMENTATION the time
+    // it spent queued and the time it ran go to the task_wait and task_run
+    // histograms, including the destructor since captured state is freed
+    // on the worker.
+    static void run(task &job) {
+#ifdef QUANT_INSTRUMENTATION
+        std::uint64_t start = latency_clock::now();
+        latency_record(latency_point::task_wait, start > job.queued_at ? start - job.queued_at : 0);
+        job();
+        job.reset();
+        latency_record(latency_point::task_run, latency_clock::now() - start);
+#else
+        job();
+        job.reset();
+#endif
+    }
+
+    // the cpus this process may run on must include every requested core,
+    // a worker that silently stays unpinned would defeat the point
+    static void check_cores(const std::vector<int> &cores) {
+        if (cores.empty()) {
+            return;
+        }
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            throw std::runtime_error("cannot read the process cpu affinity");
+        }
+        for (int core : cores) {
+            if (core < 0 || core >= CPU_SETSIZE || !CPU_ISSET(core, &allowed)) {
+                throw std::invalid_argument("thread_pool core " + std::to_string(core) +
+                                            " is not available to this process");
+            }
+        }
+#else
+        throw std::invalid_argument("thread_pool cannot pin workers on this platform");
+#endif
+    }
+
+    // first thing on every worker: pin it, build its per worker state on
+    // the core it will run on, then wait for the rest of the pool
+    void start_worker(size_t self) {
+        if (!cores.empty()) {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cores[self % cores.size()], &set);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+                pin_failures.fetch_add(1);
+            }
+#endif
+        }
+        if (mode == scheduling::work_stealing) {
+            local_queues[self] = std::make_unique<worker_queue>();
+        }
+        current_pool = this;
+        current_worker = self;
+        current_rng = 0x9E3779B97F4A7C15ull * (self + 1);
+        started.arrive_and_wait();
+    }
+
+    // polls ready() the way the idle policy says. true once it holds,
+    // false when the worker should go to sleep instead.
+    template <class P> bool wait_idle(P &&ready) const {
+        if (idle == idle_policy::block) {
+            return false;
+        }
+        for (int spin = 0; spin < spin_count; ++spin) {
+            if (ready()) {
+                return true;
+            }
+            cpu_relax();
+        }
+        if (idle == idle_policy::spin_then_park) {
+            return false;
+        }
+        while (!ready()) {
+            if (idle == idle_policy::spin) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        return true;
+    }
+
+    bool work_or_stop() const {
+        return queued.load(std::memory_order_relaxed) > 0 || stopping.load(std::memory_order_relaxed);
+    }
+
+    void shared_queue_worker(size_t self) {
+        start_worker(self);
+        task job;
+        while (true) {
+            // polling workers only take the lock once there is something
+            // to take, and are not counted as waiting so submit never
+            // signals them
+            bool polled = wait_idle([this]() { return work_or_stop(); });
+            {
+                std::unique_lock<std::mutex> lock(q_mutex);
+                if (!polled) {
+                    ++waiting_workers;
+                    cv_task.wait(lock, [this]() { return stop || !tasks.empty(); });
+                    --waiting_workers;
+                }
+                if (tasks.empty()) {
+                    if (stop) {
+                        return; // exit thread
+                    }
+                    continue; // another worker got there first, poll again
+                }
+                job = tasks.pop_front(); // extract the task
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                // track active task, counted before the lock is released so
+                // wait_for_tasks never sees an empty queue with the task in
+                // flight but not counted
+                active_tasks.fetch_add(1, std::memory_order_relaxed);
+            }
+            // if i donot use scopes, then it will run task with lock
+            // which can create deadlock, alternative is to unlock before
+            // running the task and lock after that but it creates overhead
+            run(job); // execute the task
+            task_done();
+        }
+    }
+
+    // mark a dequeued task as done, the last one wakes up wait_for_tasks
+    // (in shared_queue mode the waiters re-check the queue themselves
+    // under q_mutex)
+    void task_done() {
+        std::atomic<size_t> &count =
+            mode == scheduling::work_stealing ? unfinished : active_tasks;
+        if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::unique_lock<std::mutex> wait_lock(wait_mutex);
+            cv_wait.notify_all();
+        }
+    }
+
+    // one queued task on the calling worker, false when there was none.
+    // lets a worker that waits on a task_group keep the pool moving
+    // instead of blocking a thread the group may need.
+    bool run_one() {
+        task job;
+        if (mode == scheduling::work_stealing) {
+            if (!pop_local(current_worker, job) && !pop_injected(job) &&
+                !steal(current_worker, current_rng, job)) {
+                return false;
+            }
+        } else {
+            std::unique_lock<std::mutex> lock(q_mutex);
+            if (tasks.empty()) {
+                return false;
+            }
+            job = tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            active_tasks.fetch_add(1, std::memory_order_relaxed);
+        }
+        run(job);
+        task_done();
+        return true;
+    }
+
+    // tasks from one of our workers go to its own deque, anything from
+    // outside goes to the shared injection queue, so an outside producer
+    // only ever touches one lock
+    void push_local(task &&t) {
+        unfinished.fetch_add(1, std::memory_order_relaxed);
+        worker_queue &q = current_pool == this ? *local_queues[current_worker] : injected;
+        q.lock();
+        q.tasks.push_back(std::move(t));
+        q.unlock();
+        queued.fetch_add(1);
+        wake_one();
+    }
+
+    // wake a parked worker, unless one is already awake looking for work
+    // (it will find the task, and wakes the next one if more are queued)
+    void wake_one() {
+        if (sleepers.load() > 0 && searching.load() == 0) {
+            std::unique_lock<std::mutex> lock(park_mutex);
+            cv_park.notify_one();
+        }
+    }
+
+    bool pop_local(size_t self, task &job) {
+        worker_queue &q = *local_queues[self];
+        q.lock();
+        if (q.tasks.empty()) {
+            q.unlock();
+            return false;
+        }
+        job = q.tasks.pop_back();
+        q.unlock();
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    bool pop_injected(task &job) {
+        injected.lock();
+        if (injected.tasks.empty()) {
+            injected.unlock();
+            return false;
+        }
+        job = injected.tasks.pop_front();
+        injected.unlock();
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(size_t self, std::uint64_t &rng, task &job) {
+        size_t n = local_queues.size();
+        // xorshift, a different random victim order per attempt
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t start = static_cast<size_t>(rng % n);
+        for (size_t k = 0; k < n; ++k) {
+            size_t victim = (start + k) % n;
+            if (victim == self) {
+                continue;
+            }
+            // a busy victim is skipped rather than waited for
+            worker_queue &q = *local_queues[victim];
+            if (!q.try_lock()) {
+                continue;
+            }
+            if (!q.tasks.empty()) {
+                job = q.tasks.pop_front();
+                q.unlock();
+                queued.fetch_sub(1);
+                return true;
+            }
+            q.unlock();
+        }
+        return false;
+    }
+
+    void stealing_worker(size_t self) {
+        start_worker(self);
+        task job;
+        while (true) {
+            if (pop_local(self, job) || pop_injected(job) || steal(self, current_rng, job)) {
+                if (queued.load(std::memory_order_relaxed) > 0) {
+                    wake_one();
+                }
+                run(job);
+                task_done();
+                continue;
+            }
+            // poll for new work before paying for a futex sleep. the default
+            // spin is kept short so idle workers do not eat the cpu of the
+            // thread that is producing the work.
+            searching.fetch_add(1);
+            bool found = wait_idle([this]() { return work_or_stop(); });
+            searching.fetch_sub(1);
+            if (found) {
+                if (stopping.load() && queued.load() == 0) {
+                    return;
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(park_mutex);
+            sleepers.fetch_add(1);
+            // re-check after announcing ourselves, a push either sees the
+            // sleeper or we see its task
+            cv_park.wait(lock, [this]() { return queued.load() > 0 || stopping.load(); });
+            sleepers.fetch_sub(1);
+            if (stopping.load() && queued.load() == 0) {
+                return;
+            }
+        }
+    }
 };
\ No newline at end of file